@@ -0,0 +1,135 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "bodies.h"
+
+
+/*
+ * One integration step over every player, with the ball inside a player
+ * record the size of the game's (address, scores, send state and the
+ * interpolation buffer around it) and with the balls on their own.
+ */
+
+
+#define PLAYERS (10000)
+#define STEPS   (2000)
+#define NUM     (95)
+#define DEN     (100)
+
+
+struct ball {
+	int x;
+	int y;
+	int dx;
+	int dy;
+	int ddx;
+	int ddy;
+	int r;
+};
+
+
+struct player {
+	uint32_t    id;
+	char        addr[128];
+	uint64_t    scores[2];
+	struct ball ball;
+	char        cold[952];
+};
+
+
+static double now_ns(void)
+{
+	struct timespec spec;
+
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return spec.tv_sec*1e9 + spec.tv_nsec;
+}
+
+
+/* velocities decay to zero in a few dozen steps, keep them moving */
+static void kick(struct player *players, bodies *b, int s)
+{
+	size_t i;
+
+	if (s%32)
+		return;
+	for (i = 0; i < PLAYERS; i++) {
+		players[i].ball.dx = b->dx[i] = (int)(i%61) - 30;
+		players[i].ball.dy = b->dy[i] = (int)(i%67) - 33;
+	}
+}
+
+
+int main()
+{
+	struct player *players;
+	struct ball   *ball;
+	bodies *b;
+	volatile int32_t sum = 0;
+	double  t;
+	double  aos_ns;
+	double  soa_ns;
+	double  simd_ns;
+	size_t  i;
+	int     s;
+
+
+	players = calloc(PLAYERS, sizeof(*players));
+	b = bodies_create(PLAYERS);
+	if (NULL == players || NULL == b) {
+		perror("alloc");
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < PLAYERS; i++)
+		bodies_push(b);
+
+	t = now_ns();
+	for (s = 0; s < STEPS; s++) {
+		kick(players, b, s);
+		for (i = 0; i < PLAYERS; i++) {
+			ball = &players[i].ball;
+			ball->x  += ball->dx;
+			ball->dx  = ball->dx*NUM/DEN;
+			ball->y  += ball->dy;
+			ball->dy  = ball->dy*NUM/DEN;
+		}
+	}
+	aos_ns = (now_ns() - t)/STEPS;
+
+	t = now_ns();
+	for (s = 0; s < STEPS; s++) {
+		kick(players, b, s);
+		for (i = 0; i < PLAYERS; i++) {
+			b->x[i]  += b->dx[i];
+			b->dx[i]  = b->dx[i]*NUM/DEN;
+			b->y[i]  += b->dy[i];
+			b->dy[i]  = b->dy[i]*NUM/DEN;
+		}
+	}
+	soa_ns = (now_ns() - t)/STEPS;
+
+	t = now_ns();
+	for (s = 0; s < STEPS; s++) {
+		kick(players, b, s);
+		bodies_step(b, 0, NUM, DEN);
+	}
+	simd_ns = (now_ns() - t)/STEPS;
+
+	for (i = 0; i < PLAYERS; i++)
+		sum += players[i].ball.x + b->x[i];
+
+
+	printf("%d players, %zu byte records\n", PLAYERS, sizeof(*players));
+	printf("%-16s %12s %12s\n", "LAYOUT", "us/STEP", "ns/PLAYER");
+	printf("%-16s %12.1f %12.2f\n", "records", aos_ns/1e3, aos_ns/PLAYERS);
+	printf("%-16s %12.1f %12.2f\n", "arrays", soa_ns/1e3, soa_ns/PLAYERS);
+	printf("%-16s %12.1f %12.2f\n", "bodies_step", simd_ns/1e3,
+		simd_ns/PLAYERS);
+
+	bodies_free(b);
+	free(players);
+	return EXIT_SUCCESS;
+}
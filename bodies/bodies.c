@@ -0,0 +1,174 @@
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+#include "bodies.h"
+
+
+/*
+ * One step moves every body by its velocity and scales the velocity by
+ * num/den, truncating toward zero exactly like v*num/den in C, so the
+ * result does not depend on whether the vector path ran. With SSE2 four
+ * bodies go at a time: the division is a multiply by a magic number and
+ * a shift (Granlund and Montgomery), done on magnitudes since SSE2 only
+ * multiplies unsigned 32-bit lanes.
+ *
+ * |v|*num must fit in 31 bits, as it must for the C expression.
+ */
+
+
+#define BODIES_MIN (16)
+
+
+static int bodies_alloc(bodies *b, size_t cap)
+{
+	int32_t **arrays[] = {&b->x, &b->y, &b->dx, &b->dy, &b->r};
+	int32_t  *p;
+	size_t    i;
+
+	for (i = 0; i < sizeof(arrays)/sizeof(arrays[0]); i++) {
+		p = realloc(*arrays[i], cap*sizeof(*p));
+		if (NULL == p)
+			return -1;
+		*arrays[i] = p;
+	}
+	b->cap = cap;
+	return 0;
+}
+
+
+bodies* bodies_create(size_t capacity)
+{
+	bodies *b;
+
+	b = calloc(1, sizeof(*b));
+	if (NULL == b)
+		return NULL;
+	if (-1 == bodies_alloc(b, capacity < BODIES_MIN ? BODIES_MIN:capacity)) {
+		bodies_free(b);
+		return NULL;
+	}
+	return b;
+}
+
+
+int bodies_free(bodies *b)
+{
+	if (NULL == b)
+		return -1;
+	free(b->x);
+	free(b->y);
+	free(b->dx);
+	free(b->dy);
+	free(b->r);
+	free(b);
+	return 0;
+}
+
+
+/* appends a zeroed body */
+int bodies_push(bodies *b)
+{
+	size_t i = b->len;
+
+	if (b->len == b->cap && -1 == bodies_alloc(b, 2*b->cap))
+		return -1;
+	b->x[i]  = 0;
+	b->y[i]  = 0;
+	b->dx[i] = 0;
+	b->dy[i] = 0;
+	b->r[i]  = 0;
+	b->len++;
+	return 0;
+}
+
+
+void bodies_remove(bodies *b, size_t i)
+{
+	size_t ultimo = b->len - 1;
+
+	b->x[i]  = b->x[ultimo];
+	b->y[i]  = b->y[ultimo];
+	b->dx[i] = b->dx[ultimo];
+	b->dy[i] = b->dy[ultimo];
+	b->r[i]  = b->r[ultimo];
+	b->len--;
+}
+
+
+#ifdef __SSE2__
+/* low 32 bits of a*m in every lane, a < 2^32 */
+static __m128i mul_lo(__m128i a, __m128i m)
+{
+	__m128i even = _mm_mul_epu32(a, m);
+	__m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+		_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+
+/* a*m >> s in every lane, the result fitting 32 bits */
+static __m128i mul_shift(__m128i a, __m128i m, __m128i s)
+{
+	__m128i even = _mm_srl_epi64(_mm_mul_epu32(a, m), s);
+	__m128i odd  = _mm_srl_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), m), s);
+
+	return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+
+static __m128i damp(__m128i v, __m128i num, __m128i magic, __m128i shift)
+{
+	__m128i sign = _mm_srai_epi32(v, 31);
+	__m128i a = _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+
+	a = mul_shift(mul_lo(a, num), magic, shift);
+	return _mm_sub_epi32(_mm_xor_si128(a, sign), sign);
+}
+#endif
+
+
+void bodies_step(bodies *b, size_t from, int32_t num, int32_t den)
+{
+	size_t i = from;
+#ifdef __SSE2__
+	__m128i vnum;
+	__m128i vmagic;
+	__m128i vshift;
+	__m128i x;
+	__m128i dx;
+	uint64_t magic;
+	int l = 0;
+
+	/* n/den == n*magic >> (31 + l) for every n < 2^31 */
+	while (((uint64_t)1 << l) < (uint64_t)den)
+		l++;
+	magic  = ((uint64_t)1 << (31 + l))/den + 1;
+	vnum   = _mm_set1_epi32(num);
+	vmagic = _mm_set1_epi32((uint32_t)magic);
+	vshift = _mm_cvtsi32_si128(31 + l);
+
+	for (; i + 4 <= b->len; i += 4) {
+		dx = _mm_loadu_si128((const __m128i*)&b->dx[i]);
+		x  = _mm_loadu_si128((const __m128i*)&b->x[i]);
+		_mm_storeu_si128((__m128i*)&b->x[i], _mm_add_epi32(x, dx));
+		_mm_storeu_si128((__m128i*)&b->dx[i], damp(dx, vnum, vmagic, vshift));
+
+		dx = _mm_loadu_si128((const __m128i*)&b->dy[i]);
+		x  = _mm_loadu_si128((const __m128i*)&b->y[i]);
+		_mm_storeu_si128((__m128i*)&b->y[i], _mm_add_epi32(x, dx));
+		_mm_storeu_si128((__m128i*)&b->dy[i], damp(dx, vnum, vmagic, vshift));
+	}
+#endif
+
+	for (; i < b->len; i++) {
+		b->x[i]  += b->dx[i];
+		b->dx[i]  = b->dx[i]*num/den;
+		b->y[i]  += b->dy[i];
+		b->dy[i]  = b->dy[i]*num/den;
+	}
+}
@@ -0,0 +1,35 @@
+/*
+ * structure-of-arrays store of moving 2D bodies, not thread-safe
+ */
+#ifndef BODIES_H
+#define BODIES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Body i is x[i], y[i], dx[i], dy[i], r[i]. The arrays move when the
+ * store grows, and bodies_remove moves the last body into the hole.
+ */
+struct bodies {
+	int32_t *x;
+	int32_t *y;
+	int32_t *dx;
+	int32_t *dy;
+	int32_t *r;
+	size_t   len;
+	size_t   cap;
+};
+
+
+typedef struct bodies bodies;
+
+bodies* bodies_create(size_t capacity);
+int     bodies_free(  bodies *b);
+int     bodies_push(  bodies *b);
+void    bodies_remove(bodies *b, size_t i);
+void    bodies_step(  bodies *b, size_t from, int32_t num, int32_t den);
+
+
+#endif /* !BODIES_H */
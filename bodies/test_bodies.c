@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "bodies.h"
+
+
+#define BODIES (1037)
+#define STEPS  (64)
+
+
+/*
+ * The C expression every step must match, whatever path ran. Positions
+ * wrap like the vector adds do, num <= den keeps v*num in range.
+ */
+static void step_ref(int32_t *p, int32_t *v, int32_t num, int32_t den)
+{
+	*p  = (int32_t)((uint32_t)*p + (uint32_t)*v);
+	*v  = *v*num/den;
+}
+
+
+static int32_t velocity(int32_t num)
+{
+	int32_t max = (int32_t)((((uint32_t)1 << 31) - 1)/(num ? num:1));
+
+	switch (rand()%4) {
+	case 0:  return rand()%129 - 64;
+	case 1:  return -max + rand()%16;
+	case 2:  return max - rand()%16;
+	default: return (int32_t)(((uint32_t)rand() << 16 ^ rand())%max)
+			*(rand()%2 ? 1:-1);
+	}
+}
+
+
+int main()
+{
+	static const int32_t fractions[][2] = {
+		{95, 100}, {1, 1}, {0, 7}, {2, 3}, {1, 1000003}, {97, 99},
+		{3, 1 << 20}, {1 << 10, (1 << 30) + 1}
+	};
+	static int32_t x[BODIES];
+	static int32_t y[BODIES];
+	static int32_t dx[BODIES];
+	static int32_t dy[BODIES];
+	bodies *b;
+	size_t  from;
+	size_t  i;
+	int32_t num;
+	int32_t den;
+	int fails = 0;
+	int f;
+	int s;
+
+
+	b = bodies_create(0);
+	if (NULL == b) {
+		perror("bodies_create");
+		return EXIT_FAILURE;
+	}
+
+	srand(1);
+	for (f = 0; f < (int)(sizeof(fractions)/sizeof(fractions[0])); f++) {
+		num  = fractions[f][0];
+		den  = fractions[f][1];
+		from = rand()%9;
+
+		/* odd lengths leave a scalar tail after the vector loop */
+		while (b->len)
+			bodies_remove(b, 0);
+		for (i = 0; i < (size_t)(BODIES - f); i++) {
+			if (-1 == bodies_push(b)) {
+				perror("bodies_push");
+				return EXIT_FAILURE;
+			}
+			b->x[i]  = x[i]  = rand() - RAND_MAX/2;
+			b->y[i]  = y[i]  = rand() - RAND_MAX/2;
+			b->dx[i] = dx[i] = velocity(num);
+			b->dy[i] = dy[i] = velocity(num);
+		}
+
+		for (s = 0; s < STEPS && !fails; s++) {
+			bodies_step(b, from, num, den);
+			for (i = from; i < b->len; i++) {
+				step_ref(&x[i], &dx[i], num, den);
+				step_ref(&y[i], &dy[i], num, den);
+			}
+			for (i = 0; i < b->len; i++)
+				if (x[i] != b->x[i] || y[i] != b->y[i]
+				||  dx[i] != b->dx[i] || dy[i] != b->dy[i]) {
+					printf("%d/%d step %d body %zu: "
+						"(%d %d %d %d) != (%d %d %d %d)\n",
+						num, den, s, i,
+						b->x[i], b->y[i], b->dx[i], b->dy[i],
+						x[i], y[i], dx[i], dy[i]);
+					fails++;
+					break;
+				}
+		}
+	}
+
+	/* the last body fills the hole */
+	while (b->len)
+		bodies_remove(b, 0);
+	for (i = 0; i < 5; i++) {
+		bodies_push(b);
+		b->r[i] = i;
+	}
+	bodies_remove(b, 1);
+	if (4 != b->len || 4 != b->r[1] || 3 != b->r[3]) {
+		printf("remove moved the wrong body\n");
+		fails++;
+	}
+	bodies_free(b);
+
+
+	printf("%s\n", fails ? "FAIL":"OK");
+	return fails ? EXIT_FAILURE:EXIT_SUCCESS;
+}
@@ -0,0 +1,344 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "videojuego.h"
+
+
+#define BOTS_MAX      (4096)
+#define BOT_VELOCIDAD (3)
+#define BOT_LLEGADA   (3)
+#define BOT_REPORTE_MS (1000)
+
+
+/*
+ * A bot walks the maze tile by tile: once it reaches the centre of the
+ * tile it was heading to it picks a random free neighbour, avoiding the
+ * tile it came from unless it is in a dead end.
+ */
+struct bot {
+	struct jugador       jugador;
+	struct pelota        pelota;
+	struct entrada_local entrada;
+	int destino_i;
+	int destino_j;
+	int previo_i;
+	int previo_j;
+};
+
+
+struct bots {
+	struct videojuego *vj;
+	struct bot        *bot;
+	size_t             len;
+	idmap             *indice;  /* id -> bot */
+	uint64_t           enviados;
+};
+
+
+/* for the POSICION handler, there is one set of bots per process */
+static struct bots *bots_propios;
+
+
+static int bot_libre(struct videojuego *vj, int i, int j)
+{
+	if (i < 0 || tilemap_height(vj->mapa) <= i
+	||  j < 0 || tilemap_width(vj->mapa) <= j)
+		return 0;
+	return !tilemap_get(vj->mapa, j, i);
+}
+
+
+static void bot_reiniciar(struct videojuego *vj, struct bot *b)
+{
+	pelota_reiniciar(vj, &b->pelota);
+	b->destino_i = b->pelota.pos.y/vj->tile_length;
+	b->destino_j = b->pelota.pos.x/vj->tile_length;
+	b->previo_i  = -1;
+	b->previo_j  = -1;
+}
+
+
+/*
+ * Random ids like any player, so bots of other processes do not land
+ * on them. One already in use here or by a player we heard of is drawn
+ * again, vj->lock must be held.
+ */
+static void bot_id(struct bots *bs, struct bot *b)
+{
+	uint32_t id;
+	size_t i;
+
+	do {
+		id = id_aleatorio();
+	} while (0 == idmap_get(bs->indice, id, &i)
+	||       NULL != jugador_buscar(bs->vj, id));
+
+	if (b->jugador.id)
+		idmap_remove(bs->indice, b->jugador.id);
+	idmap_put(bs->indice, id, b - bs->bot);
+	b->jugador.id = id;
+}
+
+
+/* deferred, another process drew the id of one of our bots */
+static void bot_posicion(struct videojuego *vj, struct queue_message *qm)
+{
+	struct bot *b;
+	uint32_t id = qm->mensaje.datos.jugador.id;
+	size_t i;
+
+	if (0 == idmap_get(bots_propios->indice, id, &i)) {
+		b = &bots_propios->bot[i];
+		bot_id(bots_propios, b);
+		fprintf(stderr, "BOTS 0x%08x taken, now 0x%08x\n",
+			id, b->jugador.id);
+	}
+	jugador_agregar(vj, qm);
+}
+
+
+static void bot_elegir(struct videojuego *vj, struct bot *b)
+{
+	static const int di[] = {-1, 0, 1,  0};
+	static const int dj[] = { 0, 1, 0, -1};
+	int opcion[4];
+	int n = 0;
+	int k;
+	int i = b->destino_i;
+	int j = b->destino_j;
+
+	for (k = 0; k < 4; k++) {
+		if (!bot_libre(vj, i + di[k], j + dj[k]))
+			continue;
+		if (i + di[k] == b->previo_i && j + dj[k] == b->previo_j)
+			continue;
+		opcion[n++] = k;
+	}
+	if (!n) {
+		if (-1 == b->previo_i)
+			return;
+		b->destino_i = b->previo_i;
+		b->destino_j = b->previo_j;
+	} else {
+		k = opcion[rand()%n];
+		b->destino_i = i + di[k];
+		b->destino_j = j + dj[k];
+	}
+	b->previo_i = i;
+	b->previo_j = j;
+}
+
+
+/*
+ * Keys only change the velocity in steps of PIXEL_SPEED, so a key is
+ * pressed when the velocity is off by at least half a step from what
+ * the distance to the target calls for.
+ */
+static int bot_eje(int error, int velocidad, int menos, int mas)
+{
+	int objetivo = error/2;
+
+	if (BOT_VELOCIDAD < objetivo)
+		objetivo = BOT_VELOCIDAD;
+	if (objetivo < -BOT_VELOCIDAD)
+		objetivo = -BOT_VELOCIDAD;
+
+	if (2 <= objetivo - velocidad)
+		return mas;
+	if (objetivo - velocidad <= -2)
+		return menos;
+	return 0;
+}
+
+
+static int bot_teclas(struct videojuego *vj, struct bot *b)
+{
+	struct pelota *p = &b->pelota;
+	int cx = b->destino_j*vj->tile_length + vj->tile_length/2;
+	int cy = b->destino_i*vj->tile_length + vj->tile_length/2;
+
+	if (abs(cx - p->pos.x) <= BOT_LLEGADA && abs(cy - p->pos.y) <= BOT_LLEGADA) {
+		bot_elegir(vj, b);
+		cx = b->destino_j*vj->tile_length + vj->tile_length/2;
+		cy = b->destino_i*vj->tile_length + vj->tile_length/2;
+	}
+
+	return bot_eje(cx - p->pos.x, p->dpos.x,
+			ENTRADA_IZQUIERDA, ENTRADA_DERECHA)
+	     | bot_eje(cy - p->pos.y, p->dpos.y,
+			ENTRADA_ARRIBA, ENTRADA_ABAJO);
+}
+
+
+static void bot_posicion_enviar(struct bots *bs, struct bot *b, int32_t ahora)
+{
+	struct queue_message  qm_alloc = {{0}};
+	struct queue_message *qm = &qm_alloc;
+	struct jugador *j = &b->jugador;
+	struct pelota  *p = &b->pelota;
+
+	if (!envio_debe_enviar(bs->vj, j, p, ahora))
+		return;
+
+	qm->mensaje.tipo = MENSAJE_POSICION;
+	qm->mensaje.tiempo = ahora;
+	qm->mensaje.datos.jugador.id = j->id;
+	qm->mensaje.datos.jugador.x  = p->pos.x;
+	qm->mensaje.datos.jugador.y  = p->pos.y;
+	qm->mensaje.datos.jugador.dx = p->dpos.x;
+	qm->mensaje.datos.jugador.dy = p->dpos.y;
+	qm->mensaje.datos.jugador.puntos  = j->puntos;
+	qm->mensaje.datos.jugador.choques = j->choques;
+	memcpy(&qm->addr, &bs->vj->group_addr, sizeof(qm->addr));
+	queue_enqueue(bs->vj->queue_send, qm);
+
+	envio_enviado(j, p, ahora);
+	bs->enviados++;
+}
+
+
+/*
+ * Every bot is stepped from this single loop once per vj->paso_ms, the
+ * network threads are shared with the rest of the game. In
+ * MODO_CLIENTE bots only send their keys, the local step is kept to
+ * steer and matches what the server will compute from them.
+ */
+static void* bots_thread(void *param)
+{
+	struct bots *bs = param;
+	struct videojuego *vj = bs->vj;
+	struct timespec espera;
+	int32_t siguiente = time_now_ms();
+	int32_t reporte = siguiente;
+	int32_t ahora;
+	uint64_t choques;
+	struct pos desde;
+	size_t i;
+	int teclas;
+
+	while (1) {
+		mensajes_aplicar(vj);
+		ahora = time_now_ms();
+
+		for (i = 0; i < bs->len; i++) {
+			struct bot *b = &bs->bot[i];
+
+			/* a map coming in swaps vj->mapa under the lock */
+			pthread_mutex_lock(&vj->lock);
+			teclas = bot_teclas(vj, b);
+			if (teclas)
+				b->jugador.ultimo_movimiento = ahora;
+			desde = b->pelota.pos;
+			pelota_entrada(&b->pelota, teclas);
+			pelota_paso(&b->pelota);
+			if (-1 == jugador_simular(vj, &b->jugador, &desde,
+					&b->pelota, ahora))
+				bot_reiniciar(vj, b);
+			pthread_mutex_unlock(&vj->lock);
+
+			if (MODO_CLIENTE == vj->modo) {
+				b->entrada.teclas = teclas;
+				entrada_enviar(vj, b->jugador.id, &b->entrada);
+				bs->enviados++;
+			} else {
+				bot_posicion_enviar(bs, b, ahora);
+			}
+		}
+
+		if (BOT_REPORTE_MS <= ahora - reporte) {
+			for (choques = 0, i = 0; i < bs->len; i++)
+				choques += bs->bot[i].jugador.choques;
+			fprintf(stderr,
+				"BOTS %zu bots, %llu sent, %llu crashes, "
+				"%zu queued\n",
+				bs->len,
+				(unsigned long long)bs->enviados,
+				(unsigned long long)choques,
+				queue_size(vj->queue_send));
+			reporte = ahora;
+		}
+
+		siguiente += vj->paso_ms;
+		ahora = time_now_ms();
+		if (siguiente - ahora <= 0) {
+			siguiente = ahora;
+			continue;
+		}
+		espera.tv_sec  = (siguiente - ahora)/1000;
+		espera.tv_nsec = (siguiente - ahora)%1000*1000000L;
+		nanosleep(&espera, NULL);
+	}
+
+	return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+	struct videojuego *vj = NULL;
+	struct bots bs = {0};
+	pthread_t thread_recv;
+	pthread_t thread_send;
+	pthread_t thread_bots;
+	size_t  len = 10;
+	int i;
+
+
+	for (i = 1; i < argc; i++) {
+		if (0 != strcmp("--bots", argv[i]))
+			continue;
+		if (NULL == argv[i + 1]) {
+			fprintf(stderr, "Missing --bots arg\n");
+			return EXIT_FAILURE;
+		}
+		len = strtol(argv[i + 1], NULL, 0);
+	}
+	if (len < 1 || BOTS_MAX < len) {
+		fprintf(stderr, "--bots must be within [1, %d]\n", BOTS_MAX);
+		return EXIT_FAILURE;
+	}
+
+
+	vj = videojuego_crear(argc, argv, MODO_P2P);
+	bs.vj  = vj;
+	bs.len = len;
+	bs.bot = calloc(len, sizeof(*bs.bot));
+	bs.indice = idmap_create(len);
+	if (NULL == bs.bot || NULL == bs.indice) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+	bots_propios = &bs;
+	if (MODO_P2P == vj->modo)
+		mensaje_registrar(vj, MENSAJE_POSICION, bot_posicion,
+			MANEJO_DIFERIDO);
+
+	for (i = 0; i < (int)len; i++) {
+		struct bot *b = &bs.bot[i];
+
+		bot_id(&bs, b);
+		b->jugador.ultimo_movimiento = time_now_ms();
+		envio_iniciar(&b->jugador.envio, ENVIO_MIN_MS, ENVIO_MAX_MS);
+		bot_reiniciar(vj, b);
+	}
+	fprintf(stderr, "BOTS %zu bots\n", len);
+
+
+	/* joins like a game would, the map may be replaced by the peers' */
+	conexion_unirse(vj);
+	pthread_create(&thread_recv, NULL, recv_thread, vj);
+	pthread_create(&thread_send, NULL, send_thread, vj);
+	pthread_create(&thread_bots, NULL, bots_thread, &bs);
+	pthread_join(thread_recv, NULL);
+	pthread_join(thread_send, NULL);
+	pthread_join(thread_bots, NULL);
+
+
+	return EXIT_SUCCESS;
+}
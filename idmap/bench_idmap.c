@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "idmap.h"
+
+
+/*
+ * Cost of finding the player of a packet, with the index and with the
+ * linear scan over the player table it replaces.
+ */
+
+
+#define LOOKUPS (2000000)
+
+
+struct player {
+	uint32_t id;
+	char     payload[200];
+};
+
+
+static double now_ns(void)
+{
+	struct timespec spec;
+
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return spec.tv_sec*1e9 + spec.tv_nsec;
+}
+
+
+int main()
+{
+	static const size_t sizes[] = {10, 100, 1000, 10000};
+	struct player *players;
+	size_t   i;
+	size_t   k;
+	size_t   n;
+	size_t   v;
+	volatile size_t sum = 0;
+	uint32_t *ids;
+	idmap   *m;
+	double   t;
+	double   hash_ns;
+	double   scan_ns;
+	int      s;
+
+
+	printf("%8s %12s %12s\n", "PLAYERS", "INDEX ns", "SCAN ns");
+	for (s = 0; s < (int)(sizeof(sizes)/sizeof(sizes[0])); s++) {
+		n = sizes[s];
+		players = calloc(n, sizeof(*players));
+		ids = malloc(LOOKUPS*sizeof(*ids));
+		m = idmap_create(n);
+		if (NULL == players || NULL == ids || NULL == m) {
+			perror("alloc");
+			return EXIT_FAILURE;
+		}
+
+		srand(1);
+		for (i = 0; i < n; i++) {
+			players[i].id = (uint32_t)rand();
+			idmap_put(m, players[i].id, i);
+		}
+		for (i = 0; i < LOOKUPS; i++)
+			ids[i] = players[rand()%n].id;
+
+		t = now_ns();
+		for (i = 0; i < LOOKUPS; i++)
+			if (0 == idmap_get(m, ids[i], &v))
+				sum += players[v].payload[0] + v;
+		hash_ns = (now_ns() - t)/LOOKUPS;
+
+		/* the scan gets fewer lookups, it would take minutes */
+		t = now_ns();
+		for (i = 0; i < LOOKUPS/n; i++)
+			for (k = 0; k < n; k++)
+				if (players[k].id == ids[i]) {
+					sum += players[k].payload[0] + k;
+					break;
+				}
+		scan_ns = (now_ns() - t)/(LOOKUPS/n);
+
+		printf("%8zu %12.1f %12.1f\n", n, hash_ns, scan_ns);
+		idmap_free(m);
+		free(players);
+		free(ids);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "idmap.h"
+
+
+/*
+ * Linear probing over a power of two table kept at most half full, with
+ * Fibonacci hashing so consecutive ids spread out. Removal shifts the
+ * following entries of the run back instead of leaving tombstones, so
+ * lookups never get slower as players come and go.
+ */
+
+
+#define IDMAP_MIN (16)
+
+
+struct slot {
+	uint32_t key;
+	uint32_t used;
+	size_t   value;
+};
+
+
+struct idmap {
+	struct slot *slots;
+	size_t       mask;
+	size_t       len;
+	int          shift;
+};
+
+
+static size_t idmap_hash(idmap *m, uint32_t key)
+{
+	return (uint32_t)(key*2654435769u) >> m->shift;
+}
+
+
+static int idmap_alloc(idmap *m, size_t capacity)
+{
+	size_t n = IDMAP_MIN;
+	int    shift = 32 - 4;
+
+	while (n < 2*capacity) {
+		n <<= 1;
+		shift--;
+	}
+	m->slots = calloc(n, sizeof(*m->slots));
+	if (NULL == m->slots)
+		return -1;
+	m->mask  = n - 1;
+	m->shift = shift;
+	m->len   = 0;
+	return 0;
+}
+
+
+static int idmap_grow(idmap *m)
+{
+	struct slot *old = m->slots;
+	size_t       n = m->mask + 1;
+	size_t       i;
+
+	if (-1 == idmap_alloc(m, n)) {
+		m->slots = old;
+		return -1;
+	}
+	for (i = 0; i < n; i++)
+		if (old[i].used)
+			idmap_put(m, old[i].key, old[i].value);
+	free(old);
+	return 0;
+}
+
+
+idmap* idmap_create(size_t capacity)
+{
+	idmap *m;
+
+	m = calloc(1, sizeof(*m));
+	if (NULL == m)
+		return NULL;
+	if (-1 == idmap_alloc(m, capacity)) {
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+
+int idmap_free(idmap *m)
+{
+	if (NULL == m)
+		return -1;
+	free(m->slots);
+	free(m);
+	return 0;
+}
+
+
+size_t idmap_size(idmap *m)
+{
+	return m->len;
+}
+
+
+int idmap_get(idmap *m, uint32_t key, size_t *value)
+{
+	size_t i = idmap_hash(m, key);
+
+	for (; m->slots[i].used; i = (i + 1) & m->mask)
+		if (m->slots[i].key == key) {
+			if (NULL != value)
+				*value = m->slots[i].value;
+			return 0;
+		}
+	return -1;
+}
+
+
+/* inserts key or updates its value */
+int idmap_put(idmap *m, uint32_t key, size_t value)
+{
+	size_t i;
+
+	if (m->mask + 1 < 2*(m->len + 1) && -1 == idmap_grow(m))
+		return -1;
+
+	for (i = idmap_hash(m, key); m->slots[i].used; i = (i + 1) & m->mask)
+		if (m->slots[i].key == key) {
+			m->slots[i].value = value;
+			return 0;
+		}
+	m->slots[i].key   = key;
+	m->slots[i].value = value;
+	m->slots[i].used  = 1;
+	m->len++;
+	return 0;
+}
+
+
+int idmap_remove(idmap *m, uint32_t key)
+{
+	size_t i = idmap_hash(m, key);
+	size_t j;
+	size_t h;
+
+	for (; m->slots[i].used; i = (i + 1) & m->mask)
+		if (m->slots[i].key == key)
+			break;
+	if (!m->slots[i].used)
+		return -1;
+
+	/* move back every entry of the run that may sit in the hole */
+	for (j = (i + 1) & m->mask; m->slots[j].used; j = (j + 1) & m->mask) {
+		h = idmap_hash(m, m->slots[j].key);
+		if (((j - h) & m->mask) < ((j - i) & m->mask))
+			continue;
+		m->slots[i] = m->slots[j];
+		i = j;
+	}
+	m->slots[i].used = 0;
+	m->len--;
+	return 0;
+}
+
+
+void idmap_clear(idmap *m)
+{
+	memset(m->slots, 0, (m->mask + 1)*sizeof(*m->slots));
+	m->len = 0;
+}
@@ -0,0 +1,22 @@
+/*
+ * open-addressing hash index from 32-bit ids to slots, not thread-safe
+ */
+#ifndef IDMAP_H
+#define IDMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef struct idmap idmap;
+
+idmap* idmap_create(size_t capacity);
+int    idmap_free(  idmap *m);
+size_t idmap_size(  idmap *m);
+int    idmap_get(   idmap *m, uint32_t key, size_t *value);
+int    idmap_put(   idmap *m, uint32_t key, size_t  value);
+int    idmap_remove(idmap *m, uint32_t key);
+void   idmap_clear( idmap *m);
+
+
+#endif /* !IDMAP_H */
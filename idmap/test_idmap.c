@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "idmap.h"
+
+
+#define KEYS   (4096)
+#define ROUNDS (200000)
+
+
+int main()
+{
+	static size_t values[KEYS];
+	static int    present[KEYS];
+	size_t  len = 0;
+	size_t  v;
+	idmap  *m;
+	uint32_t key;
+	int fails = 0;
+	int i;
+	int k;
+
+
+	m = idmap_create(4);
+	if (NULL == m) {
+		perror("idmap_create");
+		return EXIT_FAILURE;
+	}
+
+	/* keys k*KEYS + 7 all land near each other before hashing */
+	srand(1);
+	for (i = 0; i < ROUNDS; i++) {
+		k   = rand()%KEYS;
+		key = (uint32_t)k*KEYS + 7;
+
+		switch (rand()%3) {
+		case 0:
+		case 1:
+			if (!present[k])
+				len++;
+			present[k] = 1;
+			values[k]  = rand();
+			if (-1 == idmap_put(m, key, values[k])) {
+				perror("idmap_put");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 2:
+			if ((present[k] ? 0:-1) != idmap_remove(m, key)) {
+				printf("remove %u: wrong result\n", key);
+				fails++;
+			}
+			if (present[k])
+				len--;
+			present[k] = 0;
+			break;
+		}
+
+		if (0 == i%1000)
+			for (k = 0; k < KEYS; k++) {
+				key = (uint32_t)k*KEYS + 7;
+				if (present[k] != (0 == idmap_get(m, key, &v))
+				||  (present[k] && values[k] != v)) {
+					printf("round %d: key %u wrong\n", i, key);
+					fails++;
+					break;
+				}
+			}
+	}
+	if (len != idmap_size(m)) {
+		printf("%zu keys, expected %zu\n", idmap_size(m), len);
+		fails++;
+	}
+
+	idmap_clear(m);
+	if (0 != idmap_size(m) || 0 == idmap_get(m, 7, NULL)) {
+		printf("clear left keys\n");
+		fails++;
+	}
+	idmap_free(m);
+
+
+	printf("%s\n", fails ? "FAIL":"OK");
+	return fails ? EXIT_FAILURE:EXIT_SUCCESS;
+}
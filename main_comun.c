@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include "videojuego.h"
+
+
+const char *progname = "laberynth";
+
+
+void print_options(struct videojuego *vj)
+{
+	fprintf(stderr, "HOST  = \"%s\"\n", vj->host ? vj->host:"0.0.0.0");
+	fprintf(stderr, "GROUP = \"%s\"\n", vj->group);
+	fprintf(stderr, "PORT  = %d\n", vj->port);
+	fprintf(stderr, "MODE  = %s\n",
+		MODO_SERVIDOR == vj->modo ? "server":
+		MODO_CLIENTE  == vj->modo ? "client":
+		MODO_LOCKSTEP == vj->modo ? "lockstep":"p2p");
+	fprintf(stderr, "SIM   = %d Hz\n", vj->sim_hz);
+	if (MODO_SERVIDOR != vj->modo)
+		fprintf(stderr, "RENDER = %d Hz\n", vj->render_hz);
+	if (NULL != vj->grabacion_ruta)
+		fprintf(stderr, "RECORD = \"%s\"\n", vj->grabacion_ruta);
+	if (NULL != vj->mapa_ruta)
+		fprintf(stderr, "MAP   = \"%s\"\n", vj->mapa_ruta);
+}
+
+
+void print_help(struct videojuego *vj)
+{
+	fprintf(stderr, "USAGE: %s [OPTIONS]... KAZAA_DIR TRASH_DIR\n",
+		progname);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "OPTIONS\n");
+
+	fprintf(stderr, "\t--help\n");
+	fprintf(stderr, "\t\tPrint this help\n\n");
+
+	fprintf(stderr, "\t--host IP\n");
+	fprintf(stderr, "\t\tSet IP as HOST (for binding)\n\n");
+
+	fprintf(stderr, "\t--group IP\n");
+	fprintf(stderr, "\t\tSet IP as GROUP (for multicast)\n\n");
+
+	fprintf(stderr, "\t--port NUM\n");
+	fprintf(stderr, "\t\tSet NUM as PORT\n\n");
+
+	fprintf(stderr, "\t--record FILE\n");
+	fprintf(stderr, "\t\tLog every datagram to FILE (and FILE.idx)\n\n");
+
+	fprintf(stderr, "\t--map FILE\n");
+	fprintf(stderr, "\t\tPlay on the map in FILE, a line per row, spaces are free\n\n");
+
+	fprintf(stderr, "\t--sim-hz NUM\n");
+	fprintf(stderr, "\t\tSimulate NUM steps per second, same on every peer\n\n");
+
+	if (MODO_SERVIDOR != vj->modo) {
+		fprintf(stderr, "\t--client\n");
+		fprintf(stderr, "\t\tPlay against an authoritative server\n\n");
+
+		fprintf(stderr, "\t--lockstep N\n");
+		fprintf(stderr, "\t\tPlay a lockstep match of N players\n\n");
+
+		fprintf(stderr, "\t--render-hz NUM\n");
+		fprintf(stderr, "\t\tDraw at most NUM frames per second\n\n");
+	}
+
+	print_options(vj);
+}
+
+
+int parse_args(struct videojuego *vj, int argc, char **argv)
+{
+	int i;
+	int can_exit = 0;
+
+
+	for (i = 0; i < argc; i++) {
+		if (0 == strcmp("--help", argv[i])) {
+			can_exit = 1;
+			continue;
+		}
+
+		if (0 == strcmp("--host", argv[i])) {
+			if (NULL == argv[i + 1]) {
+				print_help(vj);
+				fprintf(stderr, "Missing --host arg\n");
+				exit(EXIT_FAILURE);
+			}
+			vj->host = argv[i + 1];
+			i++;
+			continue;
+		}
+
+		if (0 == strcmp("--group", argv[i])) {
+			if (NULL == argv[i + 1]) {
+				print_help(vj);
+				fprintf(stderr, "Missing --group arg\n");
+				exit(EXIT_FAILURE);
+			}
+			vj->group = argv[i + 1];
+			i++;
+			continue;
+		}
+
+		if (0 == strcmp("--port", argv[i])) {
+			if (NULL == argv[i + 1]) {
+				print_help(vj);
+				fprintf(stderr, "Missing --port arg\n");
+				exit(EXIT_FAILURE);
+			}
+			vj->port = strtol(argv[i + 1], NULL, 0);
+			i++;
+			continue;
+		}
+
+		if (0 == strcmp("--record", argv[i])) {
+			if (NULL == argv[i + 1]) {
+				print_help(vj);
+				fprintf(stderr, "Missing --record arg\n");
+				exit(EXIT_FAILURE);
+			}
+			vj->grabacion_ruta = argv[i + 1];
+			i++;
+			continue;
+		}
+
+		if (0 == strcmp("--map", argv[i])) {
+			if (NULL == argv[i + 1]) {
+				print_help(vj);
+				fprintf(stderr, "Missing --map arg\n");
+				exit(EXIT_FAILURE);
+			}
+			vj->mapa_ruta = argv[i + 1];
+			i++;
+			continue;
+		}
+
+		if (0 == strcmp("--sim-hz", argv[i])) {
+			if (NULL == argv[i + 1]) {
+				print_help(vj);
+				fprintf(stderr, "Missing --sim-hz arg\n");
+				exit(EXIT_FAILURE);
+			}
+			vj->sim_hz = strtol(argv[i + 1], NULL, 0);
+			if (vj->sim_hz < 1 || 1000 < vj->sim_hz) {
+				print_help(vj);
+				fprintf(stderr, "--sim-hz must be within [1, 1000]\n");
+				exit(EXIT_FAILURE);
+			}
+			i++;
+			continue;
+		}
+
+		if (0 == strcmp("--render-hz", argv[i]) && MODO_SERVIDOR != vj->modo) {
+			if (NULL == argv[i + 1]) {
+				print_help(vj);
+				fprintf(stderr, "Missing --render-hz arg\n");
+				exit(EXIT_FAILURE);
+			}
+			vj->render_hz = strtol(argv[i + 1], NULL, 0);
+			if (vj->render_hz < 1 || 1000 < vj->render_hz) {
+				print_help(vj);
+				fprintf(stderr, "--render-hz must be within [1, 1000]\n");
+				exit(EXIT_FAILURE);
+			}
+			i++;
+			continue;
+		}
+
+		if (0 == strcmp("--client", argv[i]) && MODO_SERVIDOR != vj->modo) {
+			vj->modo = MODO_CLIENTE;
+			continue;
+		}
+
+		if (0 == strcmp("--lockstep", argv[i]) && MODO_SERVIDOR != vj->modo) {
+			if (NULL == argv[i + 1]) {
+				print_help(vj);
+				fprintf(stderr, "Missing --lockstep arg\n");
+				exit(EXIT_FAILURE);
+			}
+			vj->modo = MODO_LOCKSTEP;
+			vj->lockstep.jugadores = strtol(argv[i + 1], NULL, 0);
+			if (vj->lockstep.jugadores < 1
+			||  LOCKSTEP_JUGADORES < vj->lockstep.jugadores) {
+				print_help(vj);
+				fprintf(stderr, "--lockstep must be within [1, %d]\n",
+					LOCKSTEP_JUGADORES);
+				exit(EXIT_FAILURE);
+			}
+			i++;
+			continue;
+		}
+
+	}
+
+	if (can_exit) {
+		print_help(vj);
+		exit(EXIT_FAILURE);
+	}
+
+	return 0;
+}
+
+
+/*
+ * Peer and player ids, 32 random bits from the system when it has a
+ * source, so even thousands of them are unlikely to ever meet.
+ */
+uint32_t id_aleatorio(void)
+{
+	uint32_t id = 0;
+	FILE    *f;
+
+	f = fopen("/dev/urandom", "rb");
+	if (NULL != f) {
+		if (1 != fread(&id, sizeof(id), 1, f))
+			id = 0;
+		fclose(f);
+	}
+	if (0 == id)
+		id = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+	return id;
+}
+
+
+/*
+ * Another id once id turned out to be taken, mixed (FNV-1a) from the
+ * address of the other host holding it, so two hosts moving at once
+ * still end up apart and a replay draws the same one.
+ */
+uint32_t id_renovar(uint32_t id, const struct socket_addr *addr)
+{
+	const uint8_t *b = (const uint8_t*)&addr->addr;
+	socklen_t i;
+
+	id ^= 2166136261u;
+	for (i = 0; i < addr->addrlen; i++)
+		id = (id ^ b[i])*16777619u;
+	return id ? id:1;
+}
+
+
+struct videojuego* videojuego_crear(int argc, char **argv, int modo)
+{
+	struct videojuego *vj = NULL;
+	struct socket_addr propia;
+	socket_fd sonda;
+	int s;
+
+
+#ifdef _WIN32
+	if (NULL != getenv("MSYSTEM") || NULL != getenv("CYGWIN")) {
+		setvbuf(stdout, 0, _IONBF, 0);
+		setvbuf(stderr, 0, _IONBF, 0);
+	}
+#endif
+	/* processes started in the same second must still get distinct ids */
+	srand(time(NULL) ^ getpid());
+
+
+	vj = calloc(1, sizeof(*vj));
+	if (NULL == vj) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	{
+		vj->modo     = modo;
+		vj->id       = id_aleatorio();
+		vj->group    = "224.0.0.1";
+		vj->port     = 7000;
+		vj->tile_length = 25;
+		vj->envio_freno = 1;
+		vj->sim_hz      = 1000/PASO_MS;
+		vj->render_hz   = RENDER_HZ;
+	}
+	vj->jugadores_indice = idmap_create(JUGADORES);
+	vj->pelotas = bodies_create(JUGADORES);
+	vj->vistas_tb = tribuf_create();
+	vj->servidor_cercanos = spatial_create(
+		(VISTA_XLEN > VISTA_YLEN ? VISTA_XLEN:VISTA_YLEN)*vj->tile_length,
+		JUGADORES);
+	vj->jugadores_temporizadores = wheel_create(JUGADOR_TICK_MS,
+		time_now_ms());
+	if (NULL == vj->jugadores_indice || NULL == vj->pelotas
+	||  NULL == vj->vistas_tb || NULL == vj->jugadores_temporizadores
+	||  NULL == vj->servidor_cercanos) {
+		perror("videojuego_crear");
+		exit(EXIT_FAILURE);
+	}
+
+
+	/* the server simulates everybody but has no player of its own */
+	if (MODO_SERVIDOR != modo) {
+		jugador_nuevo(vj, id_aleatorio());
+		jugador_reiniciar(vj, &vj->jugadores[0]);
+		vj->jugadores[0].ultimo_movimiento = time_now_ms();
+		envio_iniciar(&vj->jugadores[0].envio, ENVIO_MIN_MS, ENVIO_MAX_MS);
+	}
+
+
+	vj->bg_color.hue   = 210.0;
+	vj->bg_color.sat   = 80.0;
+	vj->bg_color.light = 20.0;
+
+
+	progname = argv[0];
+	if (NULL != strrchr(progname, '\\'))
+		progname = strrchr(progname, '\\') + 1;
+	if (NULL != strrchr(progname, '/'))
+		progname = strrchr(progname, '/') + 1;
+	parse_args(vj, argc - 1, argv + 1);
+	vj->paso_ms = 1000/vj->sim_hz;
+	vj->width   = VISTA_XLEN*vj->tile_length;
+	vj->height  = VISTA_YLEN*vj->tile_length;
+
+	if (-1 == mapa_cargar(vj, vj->mapa_ruta) || -1 == mapa_preparar(vj)) {
+		print_options(vj);
+		fprintf(stderr, "Could not load the map from %s\n",
+			vj->mapa_ruta ? vj->mapa_ruta:"the built-in one");
+		exit(EXIT_FAILURE);
+	}
+
+
+	socket_init();
+
+	vj->sock = socket_udp4_bind(&vj->self_addr, vj->host, vj->port);
+	if (SOCKET_INVAL == vj->sock) {
+		print_options(vj);
+		fprintf(stderr, "Could not bind to [%s:%d]\n",
+			vj->host ? vj->host:"0.0.0.0", vj->port);
+		exit(EXIT_FAILURE);
+	}
+	socket_recv_timeout_ms(vj->sock, 50);
+	socket_settimetolive(vj->sock, 10);
+
+	socket_addr_set_ipv4(&vj->group_addr, vj->group);
+	socket_addr_set_port(&vj->group_addr, vj->port);
+	s = socket_group_join(vj->sock, &vj->group_addr);
+	if (-1 == s) {
+		print_options(vj);
+		fprintf(stderr, "Could not join to [%s:%d]\n",
+			vj->group ? vj->group:"0.0.0.0", vj->port);
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 * Our datagrams to the group come back from the address of the
+	 * interface the group routes through, which tells them apart from
+	 * another host that drew our id.
+	 */
+	if (NULL == vj->host) {
+		sonda = socket_udp4();
+		if (SOCKET_INVAL != sonda
+		&&  0 == socket_connect(sonda, &vj->group_addr)
+		&&  0 == socket_getselfaddr(sonda, &propia)) {
+			socket_addr_set_port(&propia, vj->port);
+			socket_addr_cpy(&vj->self_addr, &propia);
+		}
+		if (SOCKET_INVAL != sonda)
+			socket_close(sonda);
+	}
+
+	if (NULL != vj->grabacion_ruta) {
+		vj->grabacion = record_open(vj->grabacion_ruta, vj->modo,
+			vj->id);
+		if (NULL == vj->grabacion) {
+			print_options(vj);
+			fprintf(stderr, "Could not record to %s\n",
+				vj->grabacion_ruta);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	pthread_mutex_init(&vj->lock, NULL);
+
+	vj->queue_send = queue_create(sizeof(struct queue_message));
+	vj->queue_diferidos = queue_create(sizeof(struct queue_message));
+	fiable_iniciar(vj);
+	conexion_iniciar(vj);
+	mensajes_iniciar(vj);
+
+	print_options(vj);
+
+	return vj;
+}
@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "videojuego.h"
+extern int32_t time_now_ms(void);
+
+
+/*
+ * The join handshake, driven by the messages delivered and by timeouts
+ * in vj->temporizadores, all on recv_thread:
+ *
+ *     joiner                          every other peer
+ *     CONECTANDO   -- CONNECT -->     CONECTANDO, answers the map
+ *     MAPAS        <-- MAPAS ---      MAPAS
+ *     MONEDAS      --- READY -->      MONEDAS, JUGANDO
+ *     JUGANDO      <-- MUNDO ---
+ *
+ * A joiner nobody answers within CONEXION_ESPERA_MS is the first one
+ * and plays its own map, and one whose world snapshot does not arrive
+ * in that time plays without it. A peer that sends game messages
+ * without a handshake was already playing, and one that goes silent for
+ * CONEXION_INACTIVO_MS is back to SIN_CONECTAR. Silent that long again
+ * it is forgotten.
+ */
+
+
+static const char *conexion_nombres[CONEXION_ESTADOS] = {
+	"SIN_CONECTAR", "CONECTANDO", "MAPAS", "MONEDAS", "JUGANDO"
+};
+
+
+/* how long a peer may stay in each state, 0 for ever */
+static const int32_t conexion_espera[CONEXION_ESTADOS] = {
+	CONEXION_INACTIVO_MS,
+	CONEXION_ESPERA_MS,
+	CONEXION_MAPAS_MS,
+	CONEXION_MAPAS_MS,
+	CONEXION_INACTIVO_MS
+};
+
+
+struct conexion* conexion_buscar(struct videojuego *vj, uint32_t id)
+{
+	size_t i;
+
+	if (-1 == idmap_get(vj->conexiones_indice, id, &i))
+		return NULL;
+	return vj->conexiones[i];
+}
+
+
+struct conexion* conexion_obtener(struct videojuego *vj,
+		uint32_t id, const struct socket_addr *addr)
+{
+	struct conexion **cs;
+	struct conexion  *c;
+	size_t cap;
+
+	/* another host drew our id, whoever hears the other first moves */
+	if (id == vj->id) {
+		do {
+			id = id_renovar(id, addr);
+		} while (NULL != conexion_buscar(vj, id));
+		fprintf(stderr, "Our id 0x%08x taken, now 0x%08x\n", vj->id, id);
+		__atomic_store_n(&vj->id, id, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	c = conexion_buscar(vj, id);
+	if (NULL != c && 0 != socket_addr_cmp(&c->addr, addr)) {
+		/* a clash the two hosts will sort out, until then the first */
+		if (time_now_ms() - c->ultimo_paquete < CONEXION_INACTIVO_MS)
+			return NULL;
+		socket_addr_cpy(&c->addr, addr);
+	}
+	if (NULL != c) {
+		c->ultimo_paquete = time_now_ms();
+		return c;
+	}
+
+	if (vj->conexiones_len == vj->conexiones_cap) {
+		cap = vj->conexiones_cap ? 2*vj->conexiones_cap:JUGADORES;
+		cs = realloc(vj->conexiones, cap*sizeof(*cs));
+		if (NULL == cs)
+			return NULL;
+		vj->conexiones     = cs;
+		vj->conexiones_cap = cap;
+	}
+	c = calloc(1, sizeof(*c));
+	if (NULL == c)
+		return NULL;
+	if (-1 == idmap_put(vj->conexiones_indice, id, vj->conexiones_len)) {
+		free(c);
+		return NULL;
+	}
+	vj->conexiones[vj->conexiones_len++] = c;
+
+	c->id = id;
+	c->ultimo_paquete = time_now_ms();
+	c->estado = CONEXION_SIN_CONECTAR;
+	c->temporizador.data = c;
+	vj->conexion_estados[CONEXION_SIN_CONECTAR]++;
+	wheel_add(vj->temporizadores, &c->temporizador,
+		c->ultimo_paquete + CONEXION_INACTIVO_MS);
+	socket_addr_cpy(&c->addr, addr);
+	fprintf(stderr, "Peer 0x%08x connected\n", id);
+
+	return c;
+}
+
+
+/* the last slot moves into its place, on recv_thread */
+static void conexion_quitar(struct videojuego *vj, struct conexion *c)
+{
+	struct conexion *ultima;
+	size_t i;
+	int    k;
+
+	if (-1 == idmap_get(vj->conexiones_indice, c->id, &i))
+		return;
+	idmap_remove(vj->conexiones_indice, c->id);
+	ultima = vj->conexiones[--vj->conexiones_len];
+	if (ultima != c) {
+		vj->conexiones[i] = ultima;
+		idmap_put(vj->conexiones_indice, ultima->id, i);
+	}
+
+	/* envio_revisar compares totals across every peer ever heard */
+	vj->conexiones_perdidos  += c->secuencia.perdidos;
+	vj->conexiones_recibidos += c->secuencia.recibidos;
+	vj->conexion_estados[c->estado]--;
+	wheel_remove(vj->temporizadores, &c->temporizador);
+	fprintf(stderr, "Peer 0x%08x forgotten\n", c->id);
+	for (k = 0; k < FIABLE_CANALES; k++)
+		free(c->rx[k].pendientes);
+	free(c);
+}
+
+
+int conexion_iniciar(struct videojuego *vj)
+{
+	vj->temporizadores = wheel_create(CONEXION_TICK_MS, time_now_ms());
+	if (NULL == vj->temporizadores)
+		return -1;
+	vj->conexiones_indice = idmap_create(JUGADORES);
+	if (NULL == vj->conexiones_indice)
+		return -1;
+	vj->union_temporizador.data = NULL;
+	return 0;
+}
+
+
+static void conexion_cambiar(struct videojuego *vj, struct conexion *c,
+		int estado)
+{
+	vj->conexion_transiciones[c->estado][estado]++;
+	vj->conexion_estados[c->estado]--;
+	vj->conexion_estados[estado]++;
+	if (c->estado != estado)
+		fprintf(stderr, "Peer 0x%08x: %s -> %s\n", c->id,
+			conexion_nombres[c->estado], conexion_nombres[estado]);
+	c->estado = estado;
+
+	if (conexion_espera[estado])
+		wheel_add(vj->temporizadores, &c->temporizador,
+			time_now_ms() + conexion_espera[estado]);
+	else
+		wheel_remove(vj->temporizadores, &c->temporizador);
+}
+
+
+static void conexion_listo(struct videojuego *vj)
+{
+	struct queue_message  qm_alloc = {{0}};
+	struct queue_message *qm = &qm_alloc;
+
+	qm->mensaje.tipo = MENSAJE_READY;
+	qm->mensaje.tiempo = time_now_ms();
+	memcpy(&qm->addr, &vj->group_addr, sizeof(qm->addr));
+	fiable_enviar(vj, FIABLE_CANAL_CONTROL, qm);
+}
+
+
+/* our own side of the handshake */
+static void conexion_local(struct videojuego *vj, int estado)
+{
+	int anterior = vj->union_estado;
+
+	vj->union_estado = estado;
+	if (anterior != estado)
+		fprintf(stderr, "Join: %s -> %s\n",
+			conexion_nombres[anterior], conexion_nombres[estado]);
+
+	switch (estado) {
+	case CONEXION_CONECTANDO:
+		mapa_conectar(vj);
+		wheel_add(vj->temporizadores, &vj->union_temporizador,
+			time_now_ms() + CONEXION_ESPERA_MS);
+		break;
+	case CONEXION_MAPAS:
+		wheel_add(vj->temporizadores, &vj->union_temporizador,
+			time_now_ms() + CONEXION_MAPAS_MS);
+		break;
+	case CONEXION_MONEDAS:
+		vj->mundo_partes = 0;
+		conexion_listo(vj);
+		wheel_add(vj->temporizadores, &vj->union_temporizador,
+			time_now_ms() + CONEXION_ESPERA_MS);
+		break;
+	default:
+		wheel_remove(vj->temporizadores, &vj->union_temporizador);
+		break;
+	}
+}
+
+
+void conexion_unirse(struct videojuego *vj)
+{
+	conexion_local(vj, CONEXION_CONECTANDO);
+}
+
+
+/*
+ * Whether we answer joiner for everybody: of the peers playing, the one
+ * with the lowest id does. On recv_thread.
+ */
+int conexion_responde(struct videojuego *vj, uint32_t joiner)
+{
+	struct conexion *c;
+	size_t i;
+
+	if (CONEXION_JUGANDO != vj->union_estado)
+		return 0;
+	for (i = 0; i < vj->conexiones_len; i++) {
+		c = vj->conexiones[i];
+		if (CONEXION_JUGANDO == c->estado && joiner != c->id
+		&&  c->id < vj->id)
+			return 0;
+	}
+	return 1;
+}
+
+
+/* a map chunk arrived, or the whole map is there when completo */
+void conexion_mapa(struct videojuego *vj, int completo)
+{
+	int estado = vj->union_estado;
+
+	if (CONEXION_CONECTANDO != estado && CONEXION_MAPAS != estado)
+		return;
+	conexion_local(vj, completo ? CONEXION_MONEDAS:CONEXION_MAPAS);
+}
+
+
+/* a part of the world snapshot, the join is over once all are in */
+static void conexion_mundo(struct videojuego *vj, struct queue_message *qm)
+{
+	int partes = qm->mensaje.datos.mundo.partes;
+	int parte  = qm->mensaje.datos.mundo.parte;
+
+	if (CONEXION_MONEDAS != vj->union_estado
+	||  vj->id != qm->mensaje.datos.mundo.destino
+	||  partes < 1 || MUNDO_PARTES < partes || partes <= parte)
+		return;
+	if (vj->mundo_partes != partes) {
+		vj->mundo_partes = partes;
+		vj->mundo_faltan = partes;
+		memset(vj->mundo_recibidas, 0, sizeof(vj->mundo_recibidas));
+	}
+	if (vj->mundo_recibidas[parte/64] & (uint64_t)1 << parte%64)
+		return;
+	vj->mundo_recibidas[parte/64] |= (uint64_t)1 << parte%64;
+	if (0 == --vj->mundo_faltan)
+		conexion_local(vj, CONEXION_JUGANDO);
+}
+
+
+/* what a delivered message means for its sender's handshake */
+void conexion_evento(struct videojuego *vj, struct queue_message *qm)
+{
+	struct conexion *c;
+
+	c = conexion_buscar(vj, qm->mensaje.id);
+	if (NULL == c)
+		return;
+
+	switch (qm->mensaje.tipo) {
+	case MENSAJE_CONNECT:
+		/* a late retransmission from a peer already playing */
+		if (CONEXION_JUGANDO == c->estado)
+			break;
+		/* mapa_conexion answers it right away */
+		conexion_cambiar(vj, c, CONEXION_CONECTANDO);
+		conexion_cambiar(vj, c, CONEXION_MAPAS);
+		break;
+	case MENSAJE_READY:
+		if (CONEXION_JUGANDO == c->estado)
+			break;
+		conexion_cambiar(vj, c, CONEXION_MONEDAS);
+		conexion_cambiar(vj, c, CONEXION_JUGANDO);
+		break;
+	case MENSAJE_PING:
+	case MENSAJE_PONG:
+		break;
+	case MENSAJE_MUNDO:
+		conexion_mundo(vj, qm);
+		/* fallthrough */
+	default:
+		if (CONEXION_SIN_CONECTAR == c->estado)
+			conexion_cambiar(vj, c, CONEXION_JUGANDO);
+		break;
+	}
+}
+
+
+static void conexion_vencida(struct wheel_node *n, void *arg)
+{
+	struct videojuego *vj = arg;
+	struct conexion   *c = n->data;
+
+	if (NULL == c) {
+		/*
+		 * a map stalled (the reliable channel gave up on a chunk)
+		 * asks for it again from scratch, otherwise we play as we are
+		 */
+		if (CONEXION_MAPAS == vj->union_estado)
+			conexion_local(vj, CONEXION_CONECTANDO);
+		else
+			conexion_local(vj, CONEXION_JUGANDO);
+		return;
+	}
+
+	/* packets only touch ultimo_paquete, the timer catches up here */
+	if ((CONEXION_JUGANDO == c->estado || CONEXION_SIN_CONECTAR == c->estado)
+	&&  time_now_ms() - c->ultimo_paquete < CONEXION_INACTIVO_MS) {
+		wheel_add(vj->temporizadores, n,
+			c->ultimo_paquete + CONEXION_INACTIVO_MS);
+		return;
+	}
+	if (CONEXION_SIN_CONECTAR == c->estado)
+		conexion_quitar(vj, c);
+	else
+		conexion_cambiar(vj, c, CONEXION_SIN_CONECTAR);
+}
+
+
+/* called periodically from recv_thread */
+void conexion_revisar(struct videojuego *vj)
+{
+	wheel_advance(vj->temporizadores, time_now_ms(), conexion_vencida, vj);
+}
+
+
+int secuencia_registrar(struct secuencia *sq, uint32_t seq)
+{
+	int32_t  d;
+	uint64_t bit;
+
+	if (!sq->iniciada) {
+		sq->iniciada = 1;
+		sq->ultimo   = seq;
+		sq->ventana  = 1;
+		sq->recibidos++;
+		return SECUENCIA_NUEVO;
+	}
+
+	d = (int32_t)(seq - sq->ultimo);
+	if (0 < d) {
+		sq->perdidos += d - 1;
+		sq->ventana   = 64 <= d ? 0:sq->ventana << d;
+		sq->ventana  |= 1;
+		sq->ultimo    = seq;
+		sq->recibidos++;
+		return SECUENCIA_NUEVO;
+	}
+
+	d = -d;
+	if (64 <= d) {
+		sq->duplicados++;
+		return SECUENCIA_DUPLICADO;
+	}
+
+	bit = (uint64_t)1 << d;
+	if (sq->ventana & bit) {
+		sq->duplicados++;
+		return SECUENCIA_DUPLICADO;
+	}
+
+	sq->ventana |= bit;
+	if (sq->perdidos)
+		sq->perdidos--;
+	sq->desordenados++;
+	sq->recibidos++;
+	return SECUENCIA_ATRASADO;
+}
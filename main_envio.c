@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "videojuego.h"
+extern int32_t time_now_ms(void);
+
+
+/*
+ * A player is sent as soon as it is dirty (input, crash, or peers'
+ * extrapolation drifting past DR_UMBRAL) but never more often than
+ * min_ms times the congestion brake. Otherwise it is sent as a
+ * heartbeat, every ENVIO_LATIDO_MS while it moves, doubling up to
+ * max_ms while it stays idle.
+ */
+
+
+void envio_iniciar(struct envio *e, int32_t min_ms, int32_t max_ms)
+{
+	memset(e, 0, sizeof(*e));
+	e->sucio  = 1;
+	e->min_ms = min_ms;
+	e->max_ms = max_ms;
+	e->latido = ENVIO_LATIDO_MS;
+}
+
+
+int envio_debe_enviar(struct videojuego *vj, struct jugador *j,
+		const struct pelota *p, int32_t ahora)
+{
+	struct envio  *e = &j->envio;
+	struct pelota *q = &e->prediccion;
+	int32_t freno = vj->envio_freno < 1 ? 1:vj->envio_freno;
+
+	pelota_paso(q);
+	if (e->choques != j->choques
+	||  DR_UMBRAL < abs(p->pos.x - q->pos.x)
+	||  DR_UMBRAL < abs(p->pos.y - q->pos.y)
+	||  p->dpos.x != q->dpos.x
+	||  p->dpos.y != q->dpos.y)
+		e->sucio = 1;
+
+	if (e->sucio)
+		return freno*e->min_ms <= ahora - e->enviado;
+	return e->latido <= ahora - e->enviado;
+}
+
+
+void envio_enviado(struct jugador *j, const struct pelota *p, int32_t ahora)
+{
+	struct envio *e = &j->envio;
+
+	if (e->sucio || p->dpos.x || p->dpos.y)
+		e->latido = ENVIO_LATIDO_MS;
+	else if (e->latido < e->max_ms)
+		e->latido = 2*e->latido < e->max_ms ? 2*e->latido:e->max_ms;
+
+	e->prediccion = *p;
+	e->choques    = j->choques;
+	e->enviado    = ahora;
+	e->sucio      = 0;
+}
+
+
+/*
+ * Runs on recv_thread once per ENVIO_REVISION_MS. Loss seen on peers'
+ * streams, retransmissions on our reliable channels and a backed up
+ * send queue all count as congestion: the brake doubles on congestion
+ * and eases off one step per clean period.
+ */
+void envio_revisar(struct videojuego *vj)
+{
+	uint64_t perdidos = vj->conexiones_perdidos;
+	uint64_t recibidos = vj->conexiones_recibidos;
+	uint64_t fiables;
+	uint64_t reenviados;
+	int congestion = 0;
+	size_t i;
+
+	if (time_now_ms() - vj->envio_revisado < ENVIO_REVISION_MS)
+		return;
+	vj->envio_revisado = time_now_ms();
+
+	for (i = 0; i < vj->conexiones_len; i++) {
+		perdidos  += vj->conexiones[i]->secuencia.perdidos;
+		recibidos += vj->conexiones[i]->secuencia.recibidos;
+	}
+	pthread_mutex_lock(&vj->fiable_lock);
+	fiables    = vj->fiable_enviados;
+	reenviados = vj->fiable_reenviados;
+	pthread_mutex_unlock(&vj->fiable_lock);
+
+	/* more than 5% loss or retransmissions */
+	if (20*(perdidos - vj->envio_perdidos)
+	>   (recibidos - vj->envio_recibidos) + (perdidos - vj->envio_perdidos))
+		congestion = 1;
+	if (20*(reenviados - vj->envio_reenviados)
+	>   (fiables - vj->envio_fiables) + (reenviados - vj->envio_reenviados))
+		congestion = 1;
+	if (ENVIO_COLA_MAX < queue_size(vj->queue_send))
+		congestion = 1;
+
+	vj->envio_perdidos   = perdidos;
+	vj->envio_recibidos  = recibidos;
+	vj->envio_fiables    = fiables;
+	vj->envio_reenviados = reenviados;
+
+	if (vj->envio_freno < 1)
+		vj->envio_freno = 1;
+	if (congestion && vj->envio_freno < ENVIO_FRENO_MAX)
+		vj->envio_freno *= 2;
+	else if (!congestion && 1 < vj->envio_freno)
+		vj->envio_freno--;
+	if (congestion)
+		fprintf(stderr, "ENVIO congestion, brake x%d\n", vj->envio_freno);
+}
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "videojuego.h"
+
+
+/*
+ * MODO_CLIENTE sends one MENSAJE_ENTRADA per frame, carrying the keys
+ * of its last ENTRADA_REDUNDANCIA frames so single losses cost nothing.
+ * Once a snapshot has been seen they go straight to the server.
+ */
+void entrada_enviar(struct videojuego *vj, uint32_t id,
+		struct entrada_local *e)
+{
+	struct queue_message  qm_alloc = {{0}};
+	struct queue_message *qm = &qm_alloc;
+	uint32_t seq;
+	int n;
+	int k;
+
+	seq = ++e->seq;
+	e->historial[seq%ENTRADA_HISTORIAL] = e->teclas;
+	e->teclas = 0;
+	n = seq < ENTRADA_REDUNDANCIA ? seq:ENTRADA_REDUNDANCIA;
+
+	qm->mensaje.tipo = MENSAJE_ENTRADA;
+	qm->mensaje.tiempo = time_now_ms();
+	qm->mensaje.datos.entrada.id  = id;
+	qm->mensaje.datos.entrada.seq = seq;
+	qm->mensaje.datos.entrada.n   = n;
+	for (k = 0; k < n; k++)
+		qm->mensaje.datos.entrada.teclas[k] =
+			e->historial[(seq - (n - 1 - k))%ENTRADA_HISTORIAL];
+
+	if (vj->servidor_conocido)
+		memcpy(&qm->addr, &vj->servidor_addr, sizeof(qm->addr));
+	else
+		memcpy(&qm->addr, &vj->group_addr, sizeof(qm->addr));
+	queue_enqueue(vj->queue_send, qm);
+}
+
+
+/*
+ * Client-side prediction: the keys of this frame are sent and applied
+ * to our own ball right away, the same way the server will apply them.
+ */
+void entrada_predecir(struct videojuego *vj)
+{
+	struct jugador *j;
+	uint8_t teclas;
+
+	pthread_mutex_lock(&vj->lock);
+	teclas = vj->entrada.teclas;
+	j = &vj->jugadores[0];
+	entrada_enviar(vj, j->id, &vj->entrada);
+	jugador_paso(vj, j, teclas, time_now_ms());
+	pthread_mutex_unlock(&vj->lock);
+}
+
+
+/*
+ * Server reconciliation: the snapshot holds our ball right after input
+ * confirmada, so rewind to it and re-run the inputs sent since. When
+ * those no longer fit in the history the server's ball is taken as is.
+ */
+static void entrada_reconciliar(struct videojuego *vj,
+		const struct pelota *p, uint32_t confirmada,
+		uint64_t puntos, uint64_t choques)
+{
+	struct jugador       *j = &vj->jugadores[0];
+	struct entrada_local *e = &vj->entrada;
+	struct pelota pelota = *p;
+	uint32_t q;
+
+	/* an older snapshot, reordered on the way */
+	if ((int32_t)(confirmada - e->confirmada) < 0)
+		return;
+	e->confirmada = confirmada;
+
+	pelota.r = jugador_pelota(vj, j).r;
+	if (0 <= (int32_t)(e->seq - confirmada)
+	&&  e->seq - confirmada < ENTRADA_HISTORIAL)
+		for (q = confirmada + 1; q != e->seq + 1; q++)
+			if (-1 == pelota_simular(vj, &pelota,
+					e->historial[q%ENTRADA_HISTORIAL])) {
+				choques++;
+				puntos = 0;
+			}
+
+	jugador_pelota_poner(vj, j, &pelota);
+	j->puntos  = puntos;
+	j->choques = choques;
+}
+
+
+/* deferred handler, vj->lock is held */
+void entrada_recibir(struct videojuego *vj, struct queue_message *qm)
+{
+	struct jugador *j;
+	int n = qm->mensaje.datos.entrada.n;
+
+	if (ENTRADA_REDUNDANCIA < n)
+		return;
+
+	j = jugador_buscar(vj, qm->mensaje.datos.entrada.id);
+	/* two clients drew the same id, the first one keeps the player */
+	if (NULL != j && 0 != socket_addr_cmp(&j->addr, &qm->addr)
+	&&  time_now_ms() - j->ultimo_ping < JUGADOR_INACTIVO_MS)
+		return;
+	if (NULL == j) {
+		j = jugador_nuevo(vj, qm->mensaje.datos.entrada.id);
+		if (NULL == j)
+			return;
+		j->entrada_recibida = qm->mensaje.datos.entrada.seq - n;
+		j->entrada_aplicada = j->entrada_recibida;
+		jugador_reiniciar(vj, j);
+		fprintf(stderr, "Player 0x%08x joined\n", j->id);
+	}
+	socket_addr_cpy(&j->addr, &qm->addr);
+	j->ultimo_ping = time_now_ms();
+	jugador_entrada_recibir(j, qm->mensaje.datos.entrada.seq,
+		qm->mensaje.datos.entrada.teclas, n);
+}
+
+
+/* the balls a client can see from its own, a view across and some more */
+struct estado_interes {
+	struct videojuego *vj;
+	size_t  yo;
+	int32_t ahora;
+	size_t  n;
+	size_t  cercanos[ESTADO_JUGADORES - 1];
+	int64_t distancias[ESTADO_JUGADORES - 1];
+};
+
+
+static int64_t estado_distancia(struct videojuego *vj, size_t a, size_t b)
+{
+	int64_t dx = (int64_t)vj->pelotas->x[a] - vj->pelotas->x[b];
+	int64_t dy = (int64_t)vj->pelotas->y[a] - vj->pelotas->y[b];
+
+	return dx*dx + dy*dy;
+}
+
+
+/* keeps the nearest ones when more are in range than a datagram holds */
+static void estado_cercano(size_t i, void *arg)
+{
+	struct estado_interes *in = arg;
+	struct videojuego *vj = in->vj;
+	int64_t d;
+	size_t  lejos;
+	size_t  k;
+
+	if (i == in->yo
+	||  JUGADOR_INACTIVO_MS <= in->ahora - vj->jugadores[i].ultimo_ping)
+		return;
+	d = estado_distancia(vj, in->yo, i);
+	if (in->n < ESTADO_JUGADORES - 1) {
+		in->cercanos[in->n]   = i;
+		in->distancias[in->n] = d;
+		in->n++;
+		return;
+	}
+	for (lejos = 0, k = 1; k < in->n; k++)
+		if (in->distancias[lejos] < in->distancias[k])
+			lejos = k;
+	if (d < in->distancias[lejos]) {
+		in->cercanos[lejos]   = i;
+		in->distancias[lejos] = d;
+	}
+}
+
+
+static void estado_poner(struct videojuego *vj, struct queue_message *qm,
+		int k, size_t i)
+{
+	struct jugador *j = &vj->jugadores[i];
+
+	qm->mensaje.datos.estado.jugadores[k].id      = j->id;
+	qm->mensaje.datos.estado.jugadores[k].x       = vj->pelotas->x[i];
+	qm->mensaje.datos.estado.jugadores[k].y       = vj->pelotas->y[i];
+	qm->mensaje.datos.estado.jugadores[k].dx      = vj->pelotas->dx[i];
+	qm->mensaje.datos.estado.jugadores[k].dy      = vj->pelotas->dy[i];
+	qm->mensaje.datos.estado.jugadores[k].choques = j->choques;
+	qm->mensaje.datos.estado.jugadores[k].puntos  = j->puntos;
+	qm->mensaje.datos.estado.jugadores[k].entrada = j->entrada_aplicada;
+}
+
+
+/*
+ * One snapshot per client and server tick, straight to it: its own
+ * ball first, then at most ESTADO_JUGADORES - 1 of the ones near it,
+ * so what a client gets does not grow with the players on the server.
+ * Players that drift out of range expire on the client.
+ */
+void estado_enviar(struct videojuego *vj)
+{
+	struct queue_message  qm_alloc = {{0}};
+	struct queue_message *qm = &qm_alloc;
+	struct estado_interes in = {0};
+	int32_t ahora = time_now_ms();
+	int32_t radio = (VISTA_XLEN > VISTA_YLEN ? VISTA_XLEN:VISTA_YLEN)
+		*vj->tile_length;
+	size_t  i;
+	size_t  k;
+
+	pthread_mutex_lock(&vj->lock);
+	if (-1 == spatial_build(vj->servidor_cercanos, vj->pelotas->x,
+			vj->pelotas->y, vj->jugadores_len)) {
+		pthread_mutex_unlock(&vj->lock);
+		perror("estado_enviar");
+		return;
+	}
+
+	vj->servidor_tick++;
+	qm->mensaje.tipo = MENSAJE_ESTADO;
+	qm->mensaje.tiempo = ahora;
+	qm->mensaje.datos.estado.tick  = vj->servidor_tick;
+
+	in.vj    = vj;
+	in.ahora = ahora;
+	for (i = 0; i < vj->jugadores_len; i++) {
+		if (JUGADOR_INACTIVO_MS <= ahora - vj->jugadores[i].ultimo_ping)
+			continue;
+		in.yo = i;
+		in.n  = 0;
+		spatial_query(vj->servidor_cercanos, vj->pelotas->x[i],
+			vj->pelotas->y[i], radio, estado_cercano, &in);
+
+		estado_poner(vj, qm, 0, i);
+		for (k = 0; k < in.n; k++)
+			estado_poner(vj, qm, k + 1, in.cercanos[k]);
+		qm->mensaje.datos.estado.n = in.n + 1;
+		socket_addr_cpy(&qm->addr, &vj->jugadores[i].addr);
+		queue_enqueue(vj->queue_send, qm);
+	}
+	pthread_mutex_unlock(&vj->lock);
+}
+
+
+/* deferred handler, vj->lock is held and tiempo is already in our clock */
+void estado_recibir(struct videojuego *vj, struct queue_message *qm)
+{
+	struct pelota p = {{0}};
+	int k;
+
+	if (ESTADO_JUGADORES < qm->mensaje.datos.estado.n)
+		return;
+
+	if (!vj->servidor_conocido) {
+		socket_addr_cpy(&vj->servidor_addr, &qm->addr);
+		vj->servidor_conocido = 1;
+	}
+	vj->servidor_tick = qm->mensaje.datos.estado.tick;
+
+	for (k = 0; k < qm->mensaje.datos.estado.n; k++) {
+		p.pos.x  = qm->mensaje.datos.estado.jugadores[k].x;
+		p.pos.y  = qm->mensaje.datos.estado.jugadores[k].y;
+		p.dpos.x = qm->mensaje.datos.estado.jugadores[k].dx;
+		p.dpos.y = qm->mensaje.datos.estado.jugadores[k].dy;
+
+		if (vj->jugadores[0].id != qm->mensaje.datos.estado.jugadores[k].id) {
+			jugador_actualizar(vj,
+				qm->mensaje.datos.estado.jugadores[k].id,
+				&p, qm->mensaje.tiempo,
+				qm->mensaje.datos.estado.jugadores[k].puntos,
+				qm->mensaje.datos.estado.jugadores[k].choques);
+			continue;
+		}
+
+		entrada_reconciliar(vj, &p,
+			qm->mensaje.datos.estado.jugadores[k].entrada,
+			qm->mensaje.datos.estado.jugadores[k].puntos,
+			qm->mensaje.datos.estado.jugadores[k].choques);
+	}
+}
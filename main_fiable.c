@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "videojuego.h"
+extern int32_t time_now_ms(void);
+
+
+/*
+ * Reliable, ordered channels on top of the multicast datagrams.
+ *
+ * Every reliable message carries its channel, a per-channel sequence
+ * number and the oldest sequence number the sender still holds, so a
+ * peer that shows up mid-stream knows where to start. Receivers answer
+ * each one with a MENSAJE_ACK holding the next expected number plus a
+ * bitmask of what they already buffered past it. A message is retired
+ * once every live peer has acked it, and retransmitted after the largest
+ * RTO among the peers still missing it, doubling on every attempt.
+ */
+
+
+void rtt_muestra(struct rtt *r, int32_t ms)
+{
+	int32_t d;
+
+	if (ms < 0)
+		return;
+
+	if (0 == r->muestras) {
+		r->srtt   = ms;
+		r->rttvar = ms/2;
+	} else {
+		d = r->srtt - ms;
+		d = d < 0 ? -d:d;
+		r->rttvar = (3*r->rttvar + d)/4;
+		r->srtt   = (7*r->srtt + ms)/8;
+	}
+	r->muestras++;
+
+	r->rto = r->srtt + (4*r->rttvar < 1 ? 1:4*r->rttvar);
+	if (r->rto < FIABLE_RTO_MIN)
+		r->rto = FIABLE_RTO_MIN;
+	if (FIABLE_RTO_MAX < r->rto)
+		r->rto = FIABLE_RTO_MAX;
+}
+
+
+static int fiable_confirmado(const struct conexion_ack *a, uint32_t seq)
+{
+	int32_t d;
+
+	if (!a->iniciado)
+		return 0;
+
+	d = (int32_t)(seq - a->base);
+	if (d < 0)
+		return 1;
+	if (0 == d || 32 < d)
+		return 0;
+	return (a->mascara >> (d - 1)) & 1;
+}
+
+
+int fiable_iniciar(struct videojuego *vj)
+{
+	int k;
+
+	pthread_mutex_init(&vj->fiable_lock, NULL);
+	for (k = 0; k < FIABLE_CANALES; k++) {
+		vj->fiable[k].pendientes = queue_create(sizeof(struct queue_message));
+		if (NULL == vj->fiable[k].pendientes)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/* fiable_lock must be held */
+static void fiable_poner(struct videojuego *vj, int canal,
+		struct queue_message *qm)
+{
+	struct fiable_canal_envio *f = &vj->fiable[canal];
+	struct fiable_entrada     *e;
+
+	qm->mensaje.canal      = canal;
+	qm->mensaje.canal_seq  = f->siguiente++;
+	qm->mensaje.canal_base = f->base;
+
+	e = &f->ventana[qm->mensaje.canal_seq%FIABLE_VENTANA];
+	memcpy(&e->qm, qm, sizeof(*qm));
+	e->usado     = 1;
+	e->intentos  = 1;
+	e->enviado   = time_now_ms();
+	e->reenviado = e->enviado;
+
+	queue_enqueue(vj->queue_send, qm);
+	vj->fiable_enviados++;
+}
+
+
+int fiable_enviar(struct videojuego *vj, int canal, struct queue_message *qm)
+{
+	struct fiable_canal_envio *f;
+	int s = 0;
+
+	if (canal <= FIABLE_CANAL_NINGUNO || FIABLE_CANALES <= canal)
+		return queue_enqueue(vj->queue_send, qm);
+
+	pthread_mutex_lock(&vj->fiable_lock);
+	f = &vj->fiable[canal];
+	qm->mensaje.canal = canal;
+	if (f->siguiente - f->base < FIABLE_VENTANA && !queue_size(f->pendientes))
+		fiable_poner(vj, canal, qm);
+	else
+		s = queue_enqueue(f->pendientes, qm);
+	pthread_mutex_unlock(&vj->fiable_lock);
+
+	return s;
+}
+
+
+static void fiable_enviar_ack(struct videojuego *vj, struct conexion *c,
+		int canal)
+{
+	struct queue_message  qm_alloc = {{0}};
+	struct queue_message *qm = &qm_alloc;
+
+	qm->mensaje.tipo   = MENSAJE_ACK;
+	qm->mensaje.tiempo = time_now_ms();
+	qm->mensaje.datos.ack.destino = c->id;
+	qm->mensaje.datos.ack.canal   = canal;
+	qm->mensaje.datos.ack.base    = c->rx[canal].esperado;
+	qm->mensaje.datos.ack.mascara = c->rx[canal].presentes >> 1;
+	memcpy(&qm->addr, &vj->group_addr, sizeof(qm->addr));
+	queue_enqueue(vj->queue_send, qm);
+}
+
+
+/*
+ * Hands over everything buffered from esperado onwards, bit i of
+ * presentes marks esperado + i as buffered.
+ */
+static void fiable_drenar(struct videojuego *vj, struct conexion *c, int canal,
+		void (*entregar)(struct videojuego*, struct queue_message*))
+{
+	struct conexion_rx *rx = &c->rx[canal];
+
+	while (rx->presentes & 1) {
+		entregar(vj, &rx->pendientes[rx->esperado%FIABLE_VENTANA]);
+		rx->presentes >>= 1;
+		rx->esperado++;
+	}
+}
+
+
+void fiable_recibir(struct videojuego *vj, struct conexion *c,
+		struct queue_message *qm,
+		void (*entregar)(struct videojuego*, struct queue_message*))
+{
+	struct conexion_rx *rx;
+	int      canal = qm->mensaje.canal;
+	uint32_t seq   = qm->mensaje.canal_seq;
+	int32_t  d;
+
+	if (FIABLE_CANALES <= canal)
+		return;
+	rx = &c->rx[canal];
+
+	if (!rx->iniciado) {
+		rx->iniciado  = 1;
+		rx->esperado  = qm->mensaje.canal_base;
+		rx->presentes = 0;
+	}
+
+	/* the sender gave up on whatever is before its base */
+	d = (int32_t)(qm->mensaje.canal_base - rx->esperado);
+	if (0 < d) {
+		for (; 0 < d && rx->presentes; d--) {
+			if (rx->presentes & 1)
+				entregar(vj, &rx->pendientes[
+					rx->esperado%FIABLE_VENTANA]);
+			rx->presentes >>= 1;
+			rx->esperado++;
+		}
+		rx->esperado = qm->mensaje.canal_base;
+	}
+
+	d = (int32_t)(seq - rx->esperado);
+	if (0 == d) {
+		entregar(vj, qm);
+		rx->presentes >>= 1;
+		rx->esperado++;
+	} else if (0 < d && d < FIABLE_VENTANA) {
+		if (NULL == rx->pendientes)
+			rx->pendientes = calloc(FIABLE_VENTANA,
+				sizeof(*rx->pendientes));
+		if (NULL == rx->pendientes) {
+			perror("calloc");
+			return;
+		}
+		memcpy(&rx->pendientes[seq%FIABLE_VENTANA], qm, sizeof(*qm));
+		rx->presentes |= (uint32_t)1 << d;
+	} else if (FIABLE_VENTANA <= d) {
+		return;
+	}
+
+	fiable_drenar(vj, c, canal, entregar);
+	fiable_enviar_ack(vj, c, canal);
+}
+
+
+void fiable_ack(struct videojuego *vj, struct conexion *c,
+		struct queue_message *qm)
+{
+	struct fiable_canal_envio *f;
+	struct fiable_entrada     *e;
+	struct conexion_ack        nuevo;
+	int32_t  muestra = -1;
+	uint32_t seq;
+	int      canal = qm->mensaje.datos.ack.canal;
+
+	if (vj->id != qm->mensaje.datos.ack.destino)
+		return;
+	if (canal <= FIABLE_CANAL_NINGUNO || FIABLE_CANALES <= canal)
+		return;
+	if (c->ack[canal].iniciado
+	&& (int32_t)(qm->mensaje.datos.ack.base - c->ack[canal].base) < 0)
+		return;
+
+	pthread_mutex_lock(&vj->fiable_lock);
+	f = &vj->fiable[canal];
+
+	nuevo.iniciado = 1;
+	nuevo.base     = qm->mensaje.datos.ack.base;
+	nuevo.mascara  = qm->mensaje.datos.ack.mascara;
+
+	/* Karn: only messages sent once give an unambiguous sample */
+	for (seq = f->base; seq != f->siguiente; seq++) {
+		e = &f->ventana[seq%FIABLE_VENTANA];
+		if (!e->usado || 1 != e->intentos)
+			continue;
+		if (fiable_confirmado(&nuevo, seq)
+		&& !fiable_confirmado(&c->ack[canal], seq))
+			muestra = time_now_ms() - e->enviado;
+	}
+	c->ack[canal] = nuevo;
+	pthread_mutex_unlock(&vj->fiable_lock);
+
+	if (0 <= muestra)
+		rtt_muestra(&c->rtt, muestra);
+}
+
+
+void fiable_revisar(struct videojuego *vj)
+{
+	struct fiable_canal_envio *f;
+	struct fiable_entrada     *e;
+	struct conexion           *c;
+	struct queue_message       qm;
+	int32_t  ahora = time_now_ms();
+	int32_t  rto;
+	uint32_t seq;
+	size_t   vivos;
+	size_t   faltan;
+	size_t   i;
+	int      canal;
+
+	if (ahora - vj->fiable_revisado < FIABLE_TICK_MS)
+		return;
+	vj->fiable_revisado = ahora;
+
+	pthread_mutex_lock(&vj->fiable_lock);
+	for (canal = FIABLE_CANAL_NINGUNO + 1; canal < FIABLE_CANALES; canal++) {
+		f = &vj->fiable[canal];
+
+		for (seq = f->base; seq != f->siguiente; seq++) {
+			e = &f->ventana[seq%FIABLE_VENTANA];
+			if (!e->usado)
+				continue;
+
+			vivos  = 0;
+			faltan = 0;
+			rto    = 0;
+			for (i = 0; i < vj->conexiones_len; i++) {
+				c = vj->conexiones[i];
+				if (FIABLE_INACTIVO_MS < ahora - c->ultimo_paquete)
+					continue;
+				vivos++;
+				if (fiable_confirmado(&c->ack[canal], seq))
+					continue;
+				faltan++;
+				if (rto < (c->rtt.muestras ? c->rtt.rto:FIABLE_RTO_INICIAL))
+					rto = c->rtt.muestras ? c->rtt.rto:FIABLE_RTO_INICIAL;
+			}
+
+			if (vivos && !faltan) {
+				e->usado = 0;
+				continue;
+			}
+
+			if (!rto)
+				rto = FIABLE_RTO_INICIAL;
+			rto <<= e->intentos - 1;
+			if (FIABLE_RTO_MAX < rto)
+				rto = FIABLE_RTO_MAX;
+			if (ahora - e->reenviado < rto)
+				continue;
+
+			if (FIABLE_REINTENTOS <= e->intentos) {
+				fprintf(stderr, "FIABLE canal %d: giving up on %u "
+					"(%d peers missing)\n",
+					canal, seq, (int)faltan);
+				e->usado = 0;
+				continue;
+			}
+
+			e->intentos++;
+			e->reenviado = ahora;
+			e->qm.mensaje.canal_base = f->base;
+			queue_enqueue(vj->queue_send, &e->qm);
+			vj->fiable_reenviados++;
+		}
+
+		while (f->base != f->siguiente
+		&&     !f->ventana[f->base%FIABLE_VENTANA].usado)
+			f->base++;
+
+		while (f->siguiente - f->base < FIABLE_VENTANA
+		&&     queue_size(f->pendientes)) {
+			queue_dequeue(f->pendientes, &qm);
+			fiable_poner(vj, canal, &qm);
+		}
+	}
+	pthread_mutex_unlock(&vj->fiable_lock);
+}
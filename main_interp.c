@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "videojuego.h"
+
+
+#define INTERP_I(in, k) (((in)->cabeza + INTERP_LEN - (in)->len + (k))%INTERP_LEN)
+
+
+void interp_agregar(struct interpolacion *in, int32_t envio,
+		int32_t llegada, uint64_t choques, const struct pelota *p)
+{
+	int32_t d;
+	size_t  k;
+
+	/* RFC 3550 interarrival jitter, kept scaled by 16 */
+	if (in->len) {
+		d = (llegada - in->llegada) - (envio - in->envio);
+		d = d < 0 ? -d:d;
+		in->jitter += d - (in->jitter + 8)/16;
+	}
+	in->llegada = llegada;
+	in->envio   = envio;
+
+	if (in->len && envio <= in->buf[INTERP_I(in, in->len - 1)].tiempo)
+		envio = in->buf[INTERP_I(in, in->len - 1)].tiempo + 1;
+
+	k = in->cabeza;
+	in->buf[k].tiempo  = envio;
+	in->buf[k].choques = choques;
+	in->buf[k].pelota  = *p;
+	in->cabeza = (in->cabeza + 1)%INTERP_LEN;
+	if (in->len < INTERP_LEN)
+		in->len++;
+}
+
+
+int interp_retraso(const struct interpolacion *in)
+{
+	int r = INTERP_MIN_MS + 3*in->jitter/16;
+	return INTERP_MAX_MS < r ? INTERP_MAX_MS:r;
+}
+
+
+/*
+ * Cubic Hermite between the two snapshots around ahora - retraso, using
+ * their velocities as tangents; past the newest one it dead-reckons.
+ */
+int interp_posicion(const struct interpolacion *in, int32_t ahora,
+		int32_t paso_ms, struct pos *pos)
+{
+	const struct pelota *a;
+	const struct pelota *b;
+	struct pelota p;
+	int32_t t;
+	int32_t t0;
+	int32_t t1;
+	double  u;
+	double  h;
+	size_t  k;
+
+	if (0 == in->len)
+		return -1;
+
+	t = ahora - interp_retraso(in);
+
+	k = INTERP_I(in, in->len - 1);
+	if (in->buf[k].tiempo <= t) {
+		p = in->buf[k].pelota;
+		pelota_extrapolar(&p, (t - in->buf[k].tiempo)/paso_ms < DR_PASOS_MAX
+			? (t - in->buf[k].tiempo)/paso_ms:DR_PASOS_MAX);
+		*pos = p.pos;
+		return 0;
+	}
+
+	k = INTERP_I(in, 0);
+	if (t <= in->buf[k].tiempo) {
+		*pos = in->buf[k].pelota.pos;
+		return 0;
+	}
+
+	for (k = in->len - 1; 0 < k; k--)
+		if (in->buf[INTERP_I(in, k - 1)].tiempo <= t)
+			break;
+
+	a  = &in->buf[INTERP_I(in, k - 1)].pelota;
+	b  = &in->buf[INTERP_I(in, k)].pelota;
+	t0 = in->buf[INTERP_I(in, k - 1)].tiempo;
+	t1 = in->buf[INTERP_I(in, k)].tiempo;
+
+	/* a crash teleports the ball, don't sweep it across the maze */
+	if (in->buf[INTERP_I(in, k - 1)].choques != in->buf[INTERP_I(in, k)].choques) {
+		*pos = a->pos;
+		return 0;
+	}
+
+	u = (double)(t - t0)/(t1 - t0);
+	h = (double)(t1 - t0)/paso_ms;
+	pos->x = (2*u*u*u - 3*u*u + 1)*a->pos.x
+	       + (u*u*u - 2*u*u + u)*h*a->dpos.x
+	       + (-2*u*u*u + 3*u*u)*b->pos.x
+	       + (u*u*u - u*u)*h*b->dpos.x;
+	pos->y = (2*u*u*u - 3*u*u + 1)*a->pos.y
+	       + (u*u*u - 2*u*u + u)*h*a->dpos.y
+	       + (-2*u*u*u + 3*u*u)*b->pos.y
+	       + (u*u*u - u*u)*h*b->dpos.y;
+
+	return 0;
+}
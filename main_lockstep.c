@@ -0,0 +1,273 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "videojuego.h"
+
+
+/*
+ * Deterministic lockstep: peers only exchange their keys, one
+ * MENSAJE_LOCKSTEP per tick each, and all of them run the same integer
+ * simulation over the same inputs. The keys sampled at tick t are
+ * played at t + LOCKSTEP_RETRASO, which hides the latency, and a tick
+ * only runs once the inputs of every player are in. So no peer gets
+ * more than LOCKSTEP_RETRASO ticks ahead of another, and the last
+ * LOCKSTEP_REDUNDANCIA inputs in every message always cover a loss.
+ *
+ * Each message also carries the hash of the sender's last tick, a
+ * mismatch with ours for the same tick is a desync.
+ */
+
+
+static struct lockstep_jugador* lockstep_buscar(struct videojuego *vj,
+		uint32_t id)
+{
+	size_t i;
+
+	for (i = 0; i < vj->lockstep.len; i++)
+		if (vj->lockstep.j[i].id == id)
+			return &vj->lockstep.j[i];
+	return NULL;
+}
+
+
+/* vj->lock must be held, keeps the table sorted by id */
+static struct lockstep_jugador* lockstep_agregar(struct videojuego *vj,
+		uint32_t id)
+{
+	struct lockstep *ls = &vj->lockstep;
+	struct jugador  *j;
+	size_t i;
+
+	if (LOCKSTEP_JUGADORES <= ls->len)
+		return NULL;
+	j = jugador_buscar(vj, id);
+	if (NULL == j)
+		j = jugador_nuevo(vj, id);
+	if (NULL == j)
+		return NULL;
+
+	for (i = ls->len; 0 < i && id < ls->j[i - 1].id; i--)
+		ls->j[i] = ls->j[i - 1];
+	memset(&ls->j[i], 0, sizeof(ls->j[i]));
+	ls->j[i].id    = id;
+	ls->j[i].hasta = LOCKSTEP_RETRASO;
+	ls->len++;
+
+	jugador_reiniciar(vj, j);
+	j->choques = 0;
+	j->puntos  = 0;
+	j->ultimo_movimiento = 0;
+	j->ultimo_ping = time_now_ms();
+	return &ls->j[i];
+}
+
+
+static uint32_t fnv(uint32_t h, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ p[i])*16777619u;
+	return h;
+}
+
+
+/* vj->lock must be held */
+static uint32_t lockstep_hash(struct videojuego *vj)
+{
+	struct jugador *j;
+	struct pelota   p;
+	uint32_t h = 2166136261u;
+	int32_t  v[7];
+	size_t   i;
+
+	h = fnv(h, &vj->lockstep.tick, sizeof(vj->lockstep.tick));
+	for (i = 0; i < vj->lockstep.len; i++) {
+		j = jugador_buscar(vj, vj->lockstep.j[i].id);
+		p = jugador_pelota(vj, j);
+		v[0] = j->id;
+		v[1] = p.pos.x;
+		v[2] = p.pos.y;
+		v[3] = p.dpos.x;
+		v[4] = p.dpos.y;
+		v[5] = j->choques;
+		v[6] = j->puntos;
+		h = fnv(h, v, sizeof(v));
+	}
+	return h;
+}
+
+
+/* vj->lock must be held */
+static void lockstep_comparar(struct videojuego *vj,
+		struct lockstep_jugador *p)
+{
+	struct lockstep *ls = &vj->lockstep;
+
+	if (!p->hash_nuevo || (int32_t)(ls->tick - p->hash_tick) < 0)
+		return;
+	p->hash_nuevo = 0;
+	if (LOCKSTEP_COLA <= ls->tick - p->hash_tick)
+		return;
+	if (ls->hashes[p->hash_tick%LOCKSTEP_COLA] == p->hash)
+		return;
+
+	ls->desincronizado++;
+	fprintf(stderr, "DESYNC tick %u: player 0x%08x has 0x%08x, "
+		"we have 0x%08x\n",
+		p->hash_tick, p->id, p->hash,
+		ls->hashes[p->hash_tick%LOCKSTEP_COLA]);
+}
+
+
+/* deferred handler, vj->lock is held */
+void lockstep_recibir(struct videojuego *vj, struct queue_message *qm)
+{
+	struct lockstep_jugador *p;
+	struct jugador *j;
+	uint32_t tick = qm->mensaje.datos.lockstep.tick;
+	uint32_t t;
+	int n = qm->mensaje.datos.lockstep.n;
+
+	if (LOCKSTEP_REDUNDANCIA < n)
+		return;
+
+	p = lockstep_buscar(vj, qm->mensaje.datos.lockstep.id);
+	if (NULL == p && !vj->lockstep.iniciado)
+		p = lockstep_agregar(vj, qm->mensaje.datos.lockstep.id);
+	if (NULL == p)
+		return;
+	j = jugador_buscar(vj, p->id);
+	j->ultimo_ping = time_now_ms();
+
+	/* only contiguous inputs, a gap is covered by the next message */
+	if (n && (int32_t)(tick - n + 1 - p->hasta) <= 0
+	&&  (int32_t)(tick - p->hasta) >= 0
+	&&  tick - vj->lockstep.tick < LOCKSTEP_COLA) {
+		for (t = p->hasta; t != tick + 1; t++)
+			p->teclas[t%LOCKSTEP_COLA] =
+				qm->mensaje.datos.lockstep.teclas[n - 1 - (tick - t)];
+		p->hasta = tick + 1;
+	}
+
+	if (qm->mensaje.datos.lockstep.hash_tick) {
+		p->hash_tick  = qm->mensaje.datos.lockstep.hash_tick;
+		p->hash       = qm->mensaje.datos.lockstep.hash;
+		p->hash_nuevo = 1;
+		lockstep_comparar(vj, p);
+	}
+}
+
+
+/* vj->lock must be held, returns 0 when the tick could not run yet */
+static int lockstep_tick(struct videojuego *vj)
+{
+	struct lockstep *ls = &vj->lockstep;
+	struct lockstep_jugador *p;
+	size_t i;
+
+	for (i = 0; i < ls->len; i++)
+		if ((int32_t)(ls->j[i].hasta - ls->tick) <= 0)
+			return 0;
+
+	for (i = 0; i < ls->len; i++) {
+		p = &ls->j[i];
+		jugador_paso(vj, jugador_buscar(vj, p->id),
+			p->teclas[ls->tick%LOCKSTEP_COLA],
+			ls->tick*vj->paso_ms);
+	}
+	ls->tick++;
+	ls->hashes[ls->tick%LOCKSTEP_COLA] = lockstep_hash(vj);
+
+	for (i = 0; i < ls->len; i++)
+		lockstep_comparar(vj, &ls->j[i]);
+	return 1;
+}
+
+
+static void lockstep_enviar(struct videojuego *vj,
+		struct lockstep_jugador *yo)
+{
+	struct queue_message  qm_alloc = {{0}};
+	struct queue_message *qm = &qm_alloc;
+	struct lockstep *ls = &vj->lockstep;
+	uint32_t tick = yo->hasta - 1;
+	int n;
+	int k;
+
+	n = vj->lockstep.iniciado ? LOCKSTEP_REDUNDANCIA:0;
+	if (yo->hasta < (uint32_t)n)
+		n = yo->hasta;
+
+	qm->mensaje.tipo = MENSAJE_LOCKSTEP;
+	qm->mensaje.tiempo = time_now_ms();
+	qm->mensaje.datos.lockstep.id   = yo->id;
+	qm->mensaje.datos.lockstep.tick = tick;
+	qm->mensaje.datos.lockstep.n    = n;
+	for (k = 0; k < n; k++)
+		qm->mensaje.datos.lockstep.teclas[k] =
+			yo->teclas[(tick - (n - 1 - k))%LOCKSTEP_COLA];
+	qm->mensaje.datos.lockstep.hash_tick = ls->tick;
+	qm->mensaje.datos.lockstep.hash = ls->hashes[ls->tick%LOCKSTEP_COLA];
+	memcpy(&qm->addr, &vj->group_addr, sizeof(qm->addr));
+	queue_enqueue(vj->queue_send, qm);
+}
+
+
+/*
+ * Runs every vj->paso_ms whatever the frame rate. Until the expected
+ * number of players has been heard of it only announces itself.
+ */
+void* lockstep_thread(void *param)
+{
+	struct videojuego *vj = param;
+	struct lockstep   *ls = &vj->lockstep;
+	struct lockstep_jugador *yo;
+	struct timespec espera;
+	int32_t siguiente = time_now_ms();
+	int32_t ahora;
+
+	pthread_mutex_lock(&vj->lock);
+	lockstep_agregar(vj, vj->jugadores[0].id);
+	pthread_mutex_unlock(&vj->lock);
+
+	while (1) {
+		mensajes_aplicar(vj);
+		pthread_mutex_lock(&vj->lock);
+		yo = lockstep_buscar(vj, vj->jugadores[0].id);
+		if (!ls->iniciado && ls->jugadores <= (int)ls->len) {
+			ls->iniciado = 1;
+			fprintf(stderr, "LOCKSTEP %zu players\n", ls->len);
+		}
+		if (ls->iniciado) {
+			/* sample our keys once per tick, for a later tick */
+			if (yo->hasta == ls->tick + LOCKSTEP_RETRASO) {
+				yo->teclas[yo->hasta%LOCKSTEP_COLA] = vj->entrada.teclas;
+				vj->entrada.teclas = 0;
+				yo->hasta++;
+			}
+			if (!lockstep_tick(vj))
+				ls->esperas++;
+		}
+		lockstep_enviar(vj, yo);
+		pthread_mutex_unlock(&vj->lock);
+		vista_publicar(vj, NULL, time_now_ms());
+
+		siguiente += vj->paso_ms;
+		ahora = time_now_ms();
+		if (siguiente - ahora <= 0) {
+			siguiente = ahora;
+			continue;
+		}
+		espera.tv_sec  = (siguiente - ahora)/1000;
+		espera.tv_nsec = (siguiente - ahora)%1000*1000000L;
+		nanosleep(&espera, NULL);
+	}
+
+	return NULL;
+}
@@ -0,0 +1,424 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "videojuego.h"
+extern int32_t time_now_ms(void);
+
+
+/*
+ * The map travels as a 1-bit-per-tile bitmap (row-major, 1 = wall),
+ * either raw or as alternating runs (starting with free tiles) encoded
+ * as LEB128 varints, whichever is shorter. Whatever the encoding it has
+ * to fit the MAPA_CHUNK*MAPA_CHUNKS bytes of a transfer, and positions
+ * travel as 16 bits, signed in the server's snapshots, so that bounds
+ * the map to INT16_MAX pixels a side.
+ */
+
+static const char *mapa_defecto[] = {
+	"  xxxxxxxxxxxxxxxxx ",
+	"x xxxx        x   x ",
+	"x   xx xxxxxx x x x ",
+	"x           x x x x ",
+	"x xxxxxxxxxxx x x x ",
+	"x x           x x x ",
+	"x x xxxxxxxxxxx x x ",
+	"x x      x      x x ",
+	"x xxxxxx x xxxxxx x ",
+	"x          x      x ",
+	"xxxxxxxxxxxx xxxxxx ",
+	"x        x   x      ",
+	"  xxxxxx x xxxxxx x ",
+	"x xx   x x      x x ",
+	"x xx x x xx x x x x ",
+	"x xx x x  x x x   x ",
+	"x xx x xx   x xxxxx ",
+	"x xx x  xxx xxxxxxx ",
+	"x xx xx    x        ",
+	"xxx  xxxxxxxxxxxxxxx",
+	NULL
+};
+
+
+static size_t mapa_bits_len(int32_t xlen, int32_t ylen)
+{
+	return ((size_t)xlen*ylen + 7)/8;
+}
+
+
+static void mapa_a_bits(tilemap *m, uint8_t *bits)
+{
+	int32_t xlen = tilemap_width(m);
+	int32_t ylen = tilemap_height(m);
+	int32_t i;
+	int32_t j;
+	size_t  k;
+
+	memset(bits, 0, mapa_bits_len(xlen, ylen));
+	for (i = 0; i < ylen; i++)
+	for (j = 0; j < xlen; j++) {
+		k = (size_t)i*xlen + j;
+		if (tilemap_get(m, j, i))
+			bits[k/8] |= 1 << (k%8);
+	}
+}
+
+
+static tilemap* bits_a_mapa(const uint8_t *bits, int32_t xlen, int32_t ylen)
+{
+	tilemap *m;
+	int32_t  i;
+	int32_t  j;
+	size_t   k;
+
+	m = tilemap_create(xlen, ylen);
+	if (NULL == m)
+		return NULL;
+	for (i = 0; i < ylen; i++)
+	for (j = 0; j < xlen; j++) {
+		k = (size_t)i*xlen + j;
+		if ((bits[k/8] >> (k%8)) & 1 && -1 == tilemap_set(m, j, i, 1)) {
+			tilemap_free(m);
+			return NULL;
+		}
+	}
+	return m;
+}
+
+
+static uint32_t bits_hash(const uint8_t *bits, int32_t xlen, int32_t ylen)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	h = (h ^ (uint32_t)xlen)*16777619u;
+	h = (h ^ (uint32_t)ylen)*16777619u;
+	for (i = 0; i < mapa_bits_len(xlen, ylen); i++)
+		h = (h ^ bits[i])*16777619u;
+
+	return h ? h:1;
+}
+
+
+static size_t rle_comprimir(const uint8_t *bits, size_t tiles,
+		uint8_t *buf, size_t n)
+{
+	size_t   len = 0;
+	uint32_t run = 0;
+	int      bit = 0;
+	size_t   k;
+
+	for (k = 0; k <= tiles; k++) {
+		if (k < tiles && bit == ((bits[k/8] >> (k%8)) & 1)) {
+			run++;
+			continue;
+		}
+		do {
+			if (n <= len)
+				return 0;
+			buf[len++] = (run & 0x7f) | (0x7f < run ? 0x80:0);
+			run >>= 7;
+		} while (run);
+		bit = !bit;
+		run = 1;
+	}
+
+	return len;
+}
+
+
+static int rle_descomprimir(const uint8_t *buf, size_t n, uint8_t *bits,
+		size_t tiles)
+{
+	size_t   i = 0;
+	uint32_t run;
+	int      bit = 0;
+	int      sh;
+	size_t   k = 0;
+
+	memset(bits, 0, (tiles + 7)/8);
+	while (i < n) {
+		run = 0;
+		sh  = 0;
+		do {
+			if (n <= i || 28 < sh)
+				return -1;
+			run |= (uint32_t)(buf[i] & 0x7f) << sh;
+			sh  += 7;
+		} while (buf[i++] & 0x80);
+
+		if (tiles - k < run)
+			return -1;
+		for (; run; run--, k++)
+			if (bit)
+				bits[k/8] |= 1 << (k%8);
+		bit = !bit;
+	}
+
+	return k == tiles ? 0:-1;
+}
+
+
+/*
+ * Loads the map from a text file, a line per row and anything but a
+ * space a wall, or the built-in one when ruta is NULL. Only before the
+ * threads start.
+ */
+int mapa_cargar(struct videojuego *vj, const char *ruta)
+{
+	char   **filas = (char**)mapa_defecto;
+	char   **p;
+	char    *linea = NULL;
+	size_t   cap = 0;
+	size_t   n = 0;
+	size_t   k;
+	ssize_t  len;
+	int32_t  xlen = 0;
+	int32_t  i;
+	int32_t  j;
+	tilemap *m = NULL;
+	FILE    *f = NULL;
+
+	if (NULL != ruta) {
+		f = fopen(ruta, "r");
+		if (NULL == f) {
+			perror(ruta);
+			return -1;
+		}
+		filas = NULL;
+		while (-1 != (len = getline(&linea, &cap, f))) {
+			while (len && ('\n' == linea[len - 1] || '\r' == linea[len - 1]))
+				linea[--len] = '\0';
+			if (0 == n%64) {
+				p = realloc(filas, (n + 64)*sizeof(*filas));
+				if (NULL == p)
+					goto fin;
+				filas = p;
+			}
+			filas[n++] = linea;
+			linea = NULL;
+			cap = 0;
+		}
+	} else {
+		while (NULL != filas[n])
+			n++;
+	}
+
+	for (k = 0; k < n; k++)
+		if (xlen < (int32_t)strlen(filas[k]))
+			xlen = strlen(filas[k]);
+	if (0 == n || 0 == xlen
+	||  INT16_MAX < (int64_t)n*vj->tile_length
+	||  INT16_MAX < (int64_t)xlen*vj->tile_length) {
+		fprintf(stderr, "MAPA %dx%zu: must be 1 to %d tiles a side\n",
+			xlen, n, INT16_MAX/vj->tile_length);
+		goto fin;
+	}
+
+	m = tilemap_create(xlen, n);
+	if (NULL == m)
+		goto fin;
+	for (i = 0; i < (int32_t)n; i++)
+	for (j = 0; '\0' != filas[i][j]; j++)
+		if (' ' != filas[i][j] && -1 == tilemap_set(m, j, i, 1)) {
+			tilemap_free(m);
+			m = NULL;
+			goto fin;
+		}
+	tilemap_free(vj->mapa);
+	vj->mapa = m;
+
+fin:
+	if (NULL != f) {
+		for (k = 0; k < n; k++)
+			free(filas[k]);
+		free(filas);
+		free(linea);
+		fclose(f);
+	}
+	return NULL == m ? -1:0;
+}
+
+
+int mapa_preparar(struct videojuego *vj)
+{
+	int32_t  xlen = tilemap_width(vj->mapa);
+	int32_t  ylen = tilemap_height(vj->mapa);
+	size_t   bits_len = mapa_bits_len(xlen, ylen);
+	uint8_t *bits;
+	size_t   len;
+
+	bits = malloc(bits_len);
+	if (NULL == bits)
+		return -1;
+	mapa_a_bits(vj->mapa, bits);
+	vj->mapa_hash = bits_hash(bits, xlen, ylen);
+
+	len = rle_comprimir(bits, (size_t)xlen*ylen, vj->mapa_tx.bytes,
+		sizeof(vj->mapa_tx.bytes));
+	if (0 == len || bits_len <= len) {
+		if (sizeof(vj->mapa_tx.bytes) < bits_len) {
+			fprintf(stderr, "MAPA %dx%d: does not fit a transfer\n",
+				xlen, ylen);
+			free(bits);
+			return -1;
+		}
+		memcpy(vj->mapa_tx.bytes, bits, bits_len);
+		len = bits_len;
+		vj->mapa_tx.formato = MAPA_FORMATO_BITS;
+	} else {
+		vj->mapa_tx.formato = MAPA_FORMATO_RLE;
+	}
+	vj->mapa_tx.len    = len;
+	vj->mapa_tx.chunks = (len + MAPA_CHUNK - 1)/MAPA_CHUNK;
+	free(bits);
+
+	fprintf(stderr, "MAPA 0x%08x: %dx%d tiles in %zu chunks, "
+		"%d bytes, %d transfer chunks (%s)\n",
+		vj->mapa_hash, xlen, ylen, tilemap_chunks(vj->mapa), (int)len,
+		vj->mapa_tx.chunks,
+		MAPA_FORMATO_RLE == vj->mapa_tx.formato ? "rle":"bits");
+	return 0;
+}
+
+
+void mapa_conectar(struct videojuego *vj)
+{
+	struct queue_message  qm_alloc = {{0}};
+	struct queue_message *qm = &qm_alloc;
+
+	qm->mensaje.tipo = MENSAJE_CONNECT;
+	qm->mensaje.tiempo = time_now_ms();
+	qm->mensaje.datos.conectar.mapa_hash = vj->mapa_hash;
+	memcpy(&qm->addr, &vj->group_addr, sizeof(qm->addr));
+	fiable_enviar(vj, FIABLE_CANAL_CONTROL, qm);
+}
+
+
+/*
+ * Sends every chunk whose bit is set in chunks, or a bare header
+ * (chunks == 0) telling the peer its copy is current.
+ */
+void mapa_enviar(struct videojuego *vj, uint64_t chunks)
+{
+	struct queue_message  qm_alloc = {{0}};
+	struct queue_message *qm = &qm_alloc;
+	uint32_t off;
+	int i;
+
+	qm->mensaje.tipo = MENSAJE_MAPAS;
+	qm->mensaje.datos.mapa.hash    = vj->mapa_hash;
+	qm->mensaje.datos.mapa.total   = vj->mapa_tx.len;
+	qm->mensaje.datos.mapa.xlen    = tilemap_width(vj->mapa);
+	qm->mensaje.datos.mapa.ylen    = tilemap_height(vj->mapa);
+	qm->mensaje.datos.mapa.formato = vj->mapa_tx.formato;
+	memcpy(&qm->addr, &vj->group_addr, sizeof(qm->addr));
+
+	if (0 == chunks) {
+		qm->mensaje.tiempo = time_now_ms();
+		fiable_enviar(vj, FIABLE_CANAL_MAPA, qm);
+		return;
+	}
+
+	qm->mensaje.datos.mapa.chunks = vj->mapa_tx.chunks;
+	for (i = 0; i < vj->mapa_tx.chunks; i++) {
+		if (!(chunks & ((uint64_t)1 << i)))
+			continue;
+		off = i*MAPA_CHUNK;
+		qm->mensaje.tiempo = time_now_ms();
+		qm->mensaje.datos.mapa.chunk = i;
+		qm->mensaje.datos.mapa.len   = vj->mapa_tx.len - off < MAPA_CHUNK
+			? vj->mapa_tx.len - off:MAPA_CHUNK;
+		memcpy(qm->mensaje.datos.mapa.bytes, vj->mapa_tx.bytes + off,
+			qm->mensaje.datos.mapa.len);
+		fiable_enviar(vj, FIABLE_CANAL_MAPA, qm);
+	}
+}
+
+
+/* the new map replaces ours under vj->lock, nothing keeps pointers in */
+static void mapa_completar(struct videojuego *vj)
+{
+	int32_t  xlen = vj->mapa_rx.xlen;
+	int32_t  ylen = vj->mapa_rx.ylen;
+	size_t   bits_len = mapa_bits_len(xlen, ylen);
+	tilemap *m = NULL;
+	uint8_t *bits;
+	int s = 0;
+
+	bits = malloc(bits_len);
+	if (NULL == bits)
+		s = -1;
+	else if (MAPA_FORMATO_RLE == vj->mapa_rx.formato)
+		s = rle_descomprimir(vj->mapa_rx.bytes, vj->mapa_rx.total, bits,
+			(size_t)xlen*ylen);
+	else if (bits_len == vj->mapa_rx.total)
+		memcpy(bits, vj->mapa_rx.bytes, bits_len);
+	else
+		s = -1;
+
+	if (-1 == s || bits_hash(bits, xlen, ylen) != vj->mapa_rx.hash
+	||  NULL == (m = bits_a_mapa(bits, xlen, ylen))) {
+		fprintf(stderr, "MAPA 0x%08x: corrupt, retrying\n",
+			vj->mapa_rx.hash);
+		vj->mapa_rx.recibidos = 0;
+		free(bits);
+		return;
+	}
+	free(bits);
+
+	pthread_mutex_lock(&vj->lock);
+	tilemap_free(vj->mapa);
+	vj->mapa = m;
+	pthread_mutex_unlock(&vj->lock);
+	mapa_preparar(vj);
+	vj->mapa_rx.chunks = 0;
+	conexion_mapa(vj, 1);
+}
+
+
+void mapa_recibir(struct videojuego *vj, struct queue_message *qm)
+{
+	uint64_t todos;
+	uint32_t off;
+	struct mensaje_mapa *m = &qm->mensaje.datos.mapa;
+
+	if (m->hash == vj->mapa_hash) {
+		conexion_mapa(vj, 1);
+		return;
+	}
+	if (0 == m->xlen || INT16_MAX/vj->tile_length < m->xlen
+	|| 0 == m->ylen || INT16_MAX/vj->tile_length < m->ylen
+	|| 0 == m->chunks || MAPA_CHUNKS < m->chunks
+	|| m->chunks <= m->chunk || MAPA_CHUNK < m->len
+	|| sizeof(vj->mapa_rx.bytes) < m->total)
+		return;
+
+	/* total fills every chunk but the last, and len is this chunk's part */
+	off = m->chunk*MAPA_CHUNK;
+	if (m->total <= (uint32_t)(m->chunks - 1)*MAPA_CHUNK
+	||  (uint32_t)m->chunks*MAPA_CHUNK < m->total
+	||  m->len != (m->total - off < MAPA_CHUNK ? m->total - off:MAPA_CHUNK))
+		return;
+
+	if (m->hash != vj->mapa_rx.hash || 0 == vj->mapa_rx.chunks) {
+		vj->mapa_rx.hash      = m->hash;
+		vj->mapa_rx.total     = m->total;
+		vj->mapa_rx.chunks    = m->chunks;
+		vj->mapa_rx.formato   = m->formato;
+		vj->mapa_rx.xlen      = m->xlen;
+		vj->mapa_rx.ylen      = m->ylen;
+		vj->mapa_rx.recibidos = 0;
+	}
+
+	if (m->total != vj->mapa_rx.total || m->chunks != vj->mapa_rx.chunks)
+		return;
+	memcpy(vj->mapa_rx.bytes + off, m->bytes, m->len);
+	vj->mapa_rx.recibidos |= (uint64_t)1 << m->chunk;
+	conexion_mapa(vj, 0);
+
+	todos = MAPA_CHUNKS == vj->mapa_rx.chunks
+		? ~(uint64_t)0:((uint64_t)1 << vj->mapa_rx.chunks) - 1;
+	if (todos == vj->mapa_rx.recibidos)
+		mapa_completar(vj);
+}
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "videojuego.h"
+
+
+/*
+ * World snapshot answering MENSAJE_READY, so a joiner has every player
+ * and score one round trip after its map. Players go one after the
+ * other as
+ *
+ *     varint  id
+ *     varint  x, y, dx, dy (zigzag)
+ *     varint  puntos, choques
+ *
+ * split over as few MUNDO_BYTES parts as they fit in, never splitting
+ * a player. The server answers, or in P2P the playing peer with the
+ * lowest id. The parts go to the group on their own reliable channel,
+ * addressed to the joiner, so a lost one is sent again rather than
+ * leaving the join hanging. There are no coins in the game yet.
+ */
+
+
+#define MUNDO_REGISTRO_MAX (5 + 4*5 + 2*10)
+
+
+static void varint_poner(uint8_t *buf, size_t *len, uint64_t v)
+{
+	do {
+		buf[(*len)++] = (v & 0x7f) | (0x7f < v ? 0x80:0);
+		v >>= 7;
+	} while (v);
+}
+
+
+static int varint_leer(const uint8_t *buf, size_t n, size_t *i, uint64_t *v)
+{
+	int sh = 0;
+
+	*v = 0;
+	do {
+		if (n <= *i || 63 < sh)
+			return -1;
+		*v |= (uint64_t)(buf[*i] & 0x7f) << sh;
+		sh += 7;
+	} while (buf[(*i)++] & 0x80);
+	return 0;
+}
+
+
+static uint64_t zigzag(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+
+static int32_t dezigzag(uint64_t v)
+{
+	return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+
+static int mundo_responde(struct videojuego *vj, uint32_t joiner)
+{
+	if (MODO_SERVIDOR == vj->modo)
+		return 1;
+	if (MODO_P2P != vj->modo)
+		return 0;
+	return conexion_responde(vj, joiner);
+}
+
+
+/* inline handler of MENSAJE_READY, on recv_thread */
+void mundo_enviar(struct videojuego *vj, struct queue_message *pedido)
+{
+	struct queue_message  qm_alloc = {{0}};
+	struct queue_message *qm = &qm_alloc;
+	uint8_t *bytes;
+	size_t *fin;
+	size_t len = 0;
+	size_t n = 0;
+	size_t i;
+	size_t k;
+	struct jugador *j;
+	int32_t ahora = time_now_ms();
+	int partes;
+
+	if (!mundo_responde(vj, pedido->mensaje.id))
+		return;
+
+	/* only players heard of lately, and our own one in P2P */
+	pthread_mutex_lock(&vj->lock);
+	bytes = malloc((vj->jugadores_len + 1)*MUNDO_REGISTRO_MAX);
+	fin   = malloc((vj->jugadores_len + 1)*sizeof(*fin));
+	if (NULL == bytes || NULL == fin) {
+		pthread_mutex_unlock(&vj->lock);
+		free(bytes);
+		free(fin);
+		return;
+	}
+	for (i = 0; i < vj->jugadores_len; i++) {
+		j = &vj->jugadores[i];
+		if ((i || MODO_SERVIDOR == vj->modo)
+		&&  CONEXION_INACTIVO_MS <= ahora - j->ultimo_ping)
+			continue;
+		varint_poner(bytes, &len, j->id);
+		varint_poner(bytes, &len, zigzag(vj->pelotas->x[i]));
+		varint_poner(bytes, &len, zigzag(vj->pelotas->y[i]));
+		varint_poner(bytes, &len, zigzag(vj->pelotas->dx[i]));
+		varint_poner(bytes, &len, zigzag(vj->pelotas->dy[i]));
+		varint_poner(bytes, &len, j->puntos);
+		varint_poner(bytes, &len, j->choques);
+		fin[n++] = len;
+	}
+	qm->mensaje.datos.mundo.tick = vj->servidor_tick;
+	pthread_mutex_unlock(&vj->lock);
+
+	/* count the parts first, every one of them carries the total */
+	partes = 1;
+	for (i = 0, k = 0; i < n; i++)
+		if (MUNDO_BYTES < fin[i] - k) {
+			k = fin[i - 1];
+			partes++;
+		}
+	if (MUNDO_PARTES < partes)
+		partes = MUNDO_PARTES;
+
+	qm->mensaje.tipo = MENSAJE_MUNDO;
+	qm->mensaje.tiempo = ahora;
+	qm->mensaje.datos.mundo.destino   = pedido->mensaje.id;
+	qm->mensaje.datos.mundo.mapa_hash = vj->mapa_hash;
+	qm->mensaje.datos.mundo.jugadores = n;
+	qm->mensaje.datos.mundo.partes    = partes;
+	memcpy(&qm->addr, &vj->group_addr, sizeof(qm->addr));
+
+	for (i = 0, k = 0; i <= n; i++) {
+		if (i < n && fin[i] - k <= MUNDO_BYTES)
+			continue;
+		len = i ? fin[i - 1] - k:0;
+		qm->mensaje.datos.mundo.len = len;
+		memcpy(qm->mensaje.datos.mundo.bytes, bytes + k, len);
+		fiable_enviar(vj, FIABLE_CANAL_MUNDO, qm);
+		k += len;
+		if (partes <= ++qm->mensaje.datos.mundo.parte)
+			break;
+	}
+	free(bytes);
+	free(fin);
+}
+
+
+/* deferred handler, vj->lock is held and tiempo is already in our clock */
+void mundo_recibir(struct videojuego *vj, struct queue_message *qm)
+{
+	const uint8_t *b = qm->mensaje.datos.mundo.bytes;
+	struct pelota p = {{0}};
+	uint64_t v[7];
+	size_t   n = qm->mensaje.datos.mundo.len;
+	size_t   i = 0;
+	uint32_t yo = __atomic_load_n(&vj->id, __ATOMIC_RELAXED);
+	int k;
+
+	if (yo != qm->mensaje.datos.mundo.destino
+	||  vj->mapa_hash != qm->mensaje.datos.mundo.mapa_hash
+	||  MUNDO_BYTES < n)
+		return;
+
+	while (i < n) {
+		for (k = 0; k < 7; k++)
+			if (-1 == varint_leer(b, n, &i, &v[k]))
+				return;
+		if (vj->jugadores[0].id == v[0])
+			continue;
+
+		p.pos.x  = dezigzag(v[1]);
+		p.pos.y  = dezigzag(v[2]);
+		p.dpos.x = dezigzag(v[3]);
+		p.dpos.y = dezigzag(v[4]);
+		jugador_actualizar(vj, v[0], &p, qm->mensaje.tiempo, v[5], v[6]);
+	}
+}
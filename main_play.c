@@ -10,8 +10,6 @@
 #include "videojuego.h"
 #include "gfx_v3.h"
 
-#define PIXEL_SPEED    (4)
-#define PIXEL_DISTANCE (1)
 
 
 struct {
@@ -37,159 +35,176 @@ size_t colors_len = sizeof(colors)/sizeof(colors[0]);
 
 
 
-int32_t time_now_ms(void)
-{
-	struct timespec spec;
-	long            ms;
-	time_t          s;
-
-	clock_gettime(CLOCK_REALTIME, &spec);
+void (*handler[GFX_EVENT_LAST])(struct videojuego *vj, struct gfx_event *e);
 
-	s  = spec.tv_sec;
-	ms = round(spec.tv_nsec/1.0e6);
+void handle_keypress(struct videojuego *vj, struct gfx_event*);
 
-	return s*1000 + ms;
+void init_handlers()
+{
+	handler[GFX_EVENT_KEYPRESS] = handle_keypress;
 }
 
 
-void update_jugadores(struct videojuego *vj)
+void handle_keypress(struct videojuego *vj, struct gfx_event *e)
 {
 	struct jugador *j;
-	int i;
+	struct pelota   p;
+	struct gfx_event_key *k;
+	int teclas = 0;
+	k = &e->data.key;
+
+	if (GFX_KEY_CURSOR != k->type)
+		return;
+
+	switch (k->value[0]) {
+	case GFX_KEY_LEFT:  teclas = ENTRADA_IZQUIERDA; break;
+	case GFX_KEY_UP:    teclas = ENTRADA_ARRIBA;    break;
+	case GFX_KEY_RIGHT: teclas = ENTRADA_DERECHA;   break;
+	case GFX_KEY_DOWN:  teclas = ENTRADA_ABAJO;     break;
+	}
 
 	pthread_mutex_lock(&vj->lock);
-	for (i = 0; i < vj->jugadores_len; i++) {
-		j = &vj->jugadores[i];
-		j->pelota.pos.x  += j->pelota.dpos.x;
-		j->pelota.dpos.x *= 0.95;
-		j->pelota.pos.y  += j->pelota.dpos.y;
-		j->pelota.dpos.y *= 0.95;
+	/* predicted and sent along with the rest of this frame's keys */
+	if (MODO_CLIENTE == vj->modo || MODO_LOCKSTEP == vj->modo) {
+		vj->entrada.teclas |= teclas;
+		pthread_mutex_unlock(&vj->lock);
+		return;
 	}
+
+	j = &vj->jugadores[0];
+	p = jugador_pelota(vj, j);
+	pelota_entrada(&p, teclas);
+	jugador_pelota_poner(vj, j, &p);
+	j->ultimo_movimiento = time_now_ms();
+	j->envio.sucio = 1;
 	pthread_mutex_unlock(&vj->lock);
 }
 
 
-int jugador_check_collision_tile(struct videojuego *vj, int i, int j, struct jugador *jj)
+static int64_t reloj_us(void)
 {
-	int x0;
-	int x1;
-	int y0;
-	int y1;
-	int a0;
-	int a1;
-	int b0;
-	int b1;
-	int s = 0;
-
-	x0 = j*vj->tile_length;
-	y0 = i*vj->tile_length;
-	x1 = x0 + vj->tile_length;
-	y1 = y0 + vj->tile_length;
-	a0 = jj->pelota.pos.x - jj->pelota.r;
-	a1 = jj->pelota.pos.x + jj->pelota.r;
-	b0 = jj->pelota.pos.y - jj->pelota.r;
-	b1 = jj->pelota.pos.y + jj->pelota.r;
-
-	if (0)
-		;
-
-	else if ((x0 < a0 && a1 < x1)
-	&&       (y0 < b0 && b1 < y1))
-		s = -1;
-
-	else if ((a0 < x0 && x0 < a1)
-	&&       (b0 < y0 && y0 < b1))
-		s = -1;
-
-	else if ((a0 < x0 && x0 < a1)
-	&&       (b0 < y1 && y1 < b1))
-		s = -1;
-
-	else if ((a0 < x1 && x1 < a1)
-	&&       (b0 < y1 && y1 < b1))
-		s = -1;
-
-	else if ((a0 < x1 && x1 < a1)
-	&&       (b0 < y0 && y0 < b1))
-		s = -1;
-
-	else if ((x0 < a0 && a1 < x1)
-	&&  ((b0 < y0 && y0 < b1) || (b0 < y1 && y1 < b1)))
-		s = -1;
-
-	else if ((y0 < b0 && b1 < y1)
-	&&  ((a0 < x0 && x0 < a1) || (a0 < x1 && x1 < a1)))
-		s = -1;
-
-	return s;
+	struct timespec spec;
+
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return (int64_t)spec.tv_sec*1000000 + spec.tv_nsec/1000;
 }
 
 
-int jugador_check_collision(struct videojuego *vj, struct jugador *jj)
+/*
+ * One simulation step of vj->paso_ms. previa gets where our ball was
+ * before it, for drawing in between.
+ */
+static void play_paso(struct videojuego *vj, struct pos *previa)
 {
-	int i;
-	int j;
-	int s;
-	for (i = 0; i < MAPA_YLEN; i++) {
-		for (j = 0; j < MAPA_XLEN; j++) {
-			if (' ' == vj->mapa[i][j])
-				continue;
-			s = jugador_check_collision_tile(vj, i, j, jj);
-			if (-1 == s)
-				return -1;
-		}
-	}
-	return 0;
-}
+	struct queue_message  qm_alloc = {{0}};
+	struct queue_message *qm = &qm_alloc;
+	struct pelota p;
 
+	pthread_mutex_lock(&vj->lock);
+	previa->x = vj->pelotas->x[0];
+	previa->y = vj->pelotas->y[0];
+	pthread_mutex_unlock(&vj->lock);
 
-void (*handler[GFX_EVENT_LAST])(struct videojuego *vj, struct gfx_event *e);
+	mensajes_aplicar(vj);
+	update_jugadores(vj);
 
-void handle_keypress(struct videojuego *vj, struct gfx_event*);
+	if (MODO_CLIENTE == vj->modo) {
+		entrada_predecir(vj);
+		return;
+	}
 
-void init_handlers()
-{
-	handler[GFX_EVENT_KEYPRESS] = handle_keypress;
+	pthread_mutex_lock(&vj->lock);
+	p = jugador_pelota(vj, &vj->jugadores[0]);
+	jugador_simular(vj, &vj->jugadores[0], previa, &p, time_now_ms());
+	jugador_pelota_poner(vj, &vj->jugadores[0], &p);
+	pthread_mutex_unlock(&vj->lock);
+
+	if (envio_debe_enviar(vj, &vj->jugadores[0], &p, time_now_ms())) {
+		qm->mensaje.tipo = MENSAJE_POSICION;
+		qm->mensaje.tiempo = time_now_ms();
+		qm->mensaje.datos.jugador.id = vj->jugadores[0].id;
+		qm->mensaje.datos.jugador.x  = p.pos.x;
+		qm->mensaje.datos.jugador.y  = p.pos.y;
+		qm->mensaje.datos.jugador.dx = p.dpos.x;
+		qm->mensaje.datos.jugador.dy = p.dpos.y;
+		qm->mensaje.datos.jugador.puntos  = vj->jugadores[0].puntos;
+		qm->mensaje.datos.jugador.choques  = vj->jugadores[0].choques;
+		memcpy(&qm->addr, &vj->group_addr, sizeof(qm->addr));
+		queue_enqueue(vj->queue_send, qm);
+
+		envio_enviado(&vj->jugadores[0], &p, time_now_ms());
+	}
 }
 
 
-void handle_keypress(struct videojuego *vj, struct gfx_event *e)
+/*
+ * Fixed timestep in P2P and as a client, the same way lockstep_thread
+ * ticks: one step every vj->paso_ms, each one published as a view.
+ * Late steps run back to back, but never more than SIM_PASOS_MAX behind,
+ * past that the game slows down instead of falling further behind.
+ */
+void* sim_thread(void *param)
 {
-	struct jugador *j = &vj->jugadores[0];
-	struct gfx_event_key *k;
-	k = &e->data.key;
-
-	if (GFX_KEY_CURSOR != k->type)
-		return;
+	struct videojuego *vj = param;
+	struct timespec espera;
+	struct pos previa = {0};
+	int32_t siguiente = time_now_ms();
+	int32_t ahora;
 
 	pthread_mutex_lock(&vj->lock);
-	switch (k->value[0]) {
-	case GFX_KEY_LEFT:  j->pelota.dpos.x -= PIXEL_SPEED; j->pelota.pos.x -= PIXEL_DISTANCE; break;
-	case GFX_KEY_UP:    j->pelota.dpos.y -= PIXEL_SPEED; j->pelota.pos.y -= PIXEL_DISTANCE; break;
-	case GFX_KEY_RIGHT: j->pelota.dpos.x += PIXEL_SPEED; j->pelota.pos.x += PIXEL_DISTANCE; break;
-	case GFX_KEY_DOWN:  j->pelota.dpos.y += PIXEL_SPEED; j->pelota.pos.y += PIXEL_DISTANCE; break;
-	}
-	j->ultimo_movimiento = time_now_ms();
+	previa.x = vj->pelotas->x[0];
+	previa.y = vj->pelotas->y[0];
 	pthread_mutex_unlock(&vj->lock);
+	vista_publicar(vj, &previa, time_now_ms());
+
+	while (1) {
+		play_paso(vj, &previa);
+		vista_publicar(vj, &previa, time_now_ms());
+
+		siguiente += vj->paso_ms;
+		ahora = time_now_ms();
+		if (siguiente - ahora <= 0) {
+			if (SIM_PASOS_MAX*vj->paso_ms < ahora - siguiente)
+				siguiente = ahora;
+			continue;
+		}
+		espera.tv_sec  = (siguiente - ahora)/1000;
+		espera.tv_nsec = (siguiente - ahora)%1000*1000000L;
+		nanosleep(&espera, NULL);
+	}
+
+	return NULL;
 }
 
 
+/*
+ * Frames only draw: sim_thread, or lockstep_thread in lockstep, steps
+ * the game and publishes views, and each frame takes the newest one
+ * without vj->lock. Our ball is drawn alfa of the way from the previous
+ * step to the last one, by how long ago the view was published, remote
+ * ones go by their interpolation buffers. Only key presses take the
+ * lock here.
+ */
 void* play_thread(void *param)
 {
 	struct videojuego *vj = param;
-
-	vj->width  = MAPA_XLEN*vj->tile_length;
-	vj->height = MAPA_YLEN*vj->tile_length;
+	struct vista *v;
+	struct timespec espera;
+	struct pos centro;
+	struct pos camara;
+	int64_t cuadro_us = 1000000/vj->render_hz;
+	int64_t siguiente = reloj_us();
+	int64_t ahora;
+	double  alfa;
+	uint64_t choques = 0;
 
 	gfx_open(vj->width, vj->height + 100, "Videojuego");
 	gfx_bg_color_hsl(30.0, 100.0, 10.0);
 	gfx_color_hsl(30.0, 90.0, 80.0);
 	init_handlers();
 
-
 	while (1) {
-		struct queue_message  qm_alloc = {{0}};
-		struct queue_message *qm = &qm_alloc;
+		int crash = 0;
 		int x = 0;
 		int y = 0;
 		int i;
@@ -205,36 +220,41 @@ void* play_thread(void *param)
 		gfx_clear();
 
 
-		update_jugadores(vj);
+		v = &vj->vistas[tribuf_front(vj->vistas_tb)];
+		if (0 < v->len) {
+			crash   = choques != v->jugadores[0].choques;
+			choques = v->jugadores[0].choques;
+		}
+		alfa = (double)(time_now_ms() - v->tiempo)/vj->paso_ms;
+		alfa = alfa < 0.0 ? 0.0:1.0 < alfa ? 1.0:alfa;
 
-		if (-1 == jugador_check_collision(vj, &vj->jugadores[0])) {
-			vj->jugadores[0].choques++;
-			vj->jugadores[0].puntos = 0;
+		if (crash) {
 			vj->bg_color.hue   = 330.0;
 			vj->bg_color.sat   =  80.0;
 			vj->bg_color.light =  60.0;
-			vj->jugadores[0].pelota.r     = vj->tile_length/4;
-			vj->jugadores[0].pelota.pos.x = vj->tile_length/2;
-			vj->jugadores[0].pelota.pos.y = vj->tile_length/2;
-			vj->jugadores[0].pelota.dpos.x = 0;
-			vj->jugadores[0].pelota.dpos.y = 0;
 		} else {
-			if ((time_now_ms() - vj->jugadores[0].ultimo_movimiento) < 300) {
-				vj->jugadores[0].puntos++;
-			}
-			if (1000 < (time_now_ms() - vj->jugadores[0].ultimo_movimiento)) {
-				if (vj->jugadores[0].puntos)
-					vj->jugadores[0].puntos--;
-			}
 			vj->bg_color.hue   = 210.0;
 			vj->bg_color.sat   = 80.0;
 			vj->bg_color.light = 20.0;
 		}
 
-		for (i = 0; i < MAPA_YLEN; i++) {
-			x = 0;
-			for (j = 0; j < MAPA_XLEN; j++) {
-				if (' ' != vj->mapa[i][j]) {
+		/* our ball where it is drawn, the camera follows it */
+		centro = v->previa;
+		if (0 < v->len) {
+			centro.x += alfa*(v->jugadores[0].pos.x - v->previa.x);
+			centro.y += alfa*(v->jugadores[0].pos.y - v->previa.y);
+		}
+		vista_camara(vj, v, &centro, &camara);
+
+		for (i = 0; i < v->ylen; i++) {
+			y = (v->y0 + i)*vj->tile_length - camara.y;
+			if (y <= -vj->tile_length || vj->height <= y)
+				continue;
+			for (j = 0; j < v->xlen; j++) {
+				x = (v->x0 + j)*vj->tile_length - camara.x;
+				if (x <= -vj->tile_length || vj->width <= x)
+					continue;
+				if (v->paredes[i] >> j & 1) {
 					gfx_color_hsl(
 						vj->bg_color.hue + 100.0*sin(time_now_ms()/1000.0),
 						vj->bg_color.sat,
@@ -245,50 +265,47 @@ void* play_thread(void *param)
 					gfx_color_hsl(60.0, 90.0, 80.0);
 					gfx_fill_rect(x, y, vj->tile_length, vj->tile_length);
 				}
-				x += vj->tile_length;
 			}
-			y += vj->tile_length;
 		}
 
-		pthread_mutex_lock(&vj->lock);
-		for (i = 0; i < vj->jugadores_len; i++) {
+		for (i = 0; i < (int)v->len; i++) {
 			char score[1024];
-			if(i != 0 && time_now_ms() - vj->jugadores[i].ultimo_ping >= 3000) {
-				continue;
-			}
-			fprintf(stderr, "JUG [%02d:0x%08x]\n", i, vj->jugadores[i].id);
+			struct vista_jugador *vjug = &v->jugadores[i];
+			struct pos pos = vjug->pos;
+			int r = vjug->r;
+			if (i == 0)
+				pos = centro;
+			fprintf(stderr, "JUG [%02d:0x%08x]\n", i, vjug->id);
 			gfx_color_hsl(
 				colors[i%colors_len].hue,
 				colors[i%colors_len].sat,
 				colors[i%colors_len].light
 			);
-			sprintf(score, "ID(0x%04x) +%llu/-%llu",
-				vj->jugadores[i].id,
-				(unsigned long long)vj->jugadores[i].puntos,
-				(unsigned long long)vj->jugadores[i].choques);
+			sprintf(score, "ID(0x%08x) +%llu/-%llu",
+				vjug->id,
+				(unsigned long long)vjug->puntos,
+				(unsigned long long)vjug->choques);
 			gfx_txt(10, vj->height + 12 + 12*i, score);
 			gfx_fill_rect(
-				vj->jugadores[i].pelota.pos.x - vj->jugadores[i].pelota.r/2,
-				vj->jugadores[i].pelota.pos.y - vj->jugadores[i].pelota.r/2,
-				2*vj->jugadores[i].pelota.r,
-				2*vj->jugadores[i].pelota.r
+				pos.x - camara.x - r/2,
+				pos.y - camara.y - r/2,
+				2*r,
+				2*r
 			);
 		}
-		pthread_mutex_unlock(&vj->lock);
 
 
-		qm->mensaje.tipo = MENSAJE_POSICION;
-		qm->mensaje.tiempo = time_now_ms();
-		qm->mensaje.datos.jugador.id = vj->jugadores[0].id;
-		qm->mensaje.datos.jugador.x  = vj->jugadores[0].pelota.pos.x;
-		qm->mensaje.datos.jugador.y  = vj->jugadores[0].pelota.pos.y;
-		qm->mensaje.datos.jugador.puntos  = vj->jugadores[0].puntos;
-		qm->mensaje.datos.jugador.choques  = vj->jugadores[0].choques;
-		memcpy(&qm->addr, &vj->group_addr, sizeof(qm->addr));
-		queue_enqueue(vj->queue_send, qm);
-		
 		gfx_draw();
-		gfx_sleep_ms(16);
+
+		siguiente += cuadro_us;
+		ahora = reloj_us();
+		if (siguiente - ahora <= 0) {
+			siguiente = ahora;
+			continue;
+		}
+		espera.tv_sec  = (siguiente - ahora)/1000000;
+		espera.tv_nsec = (siguiente - ahora)%1000000*1000;
+		nanosleep(&espera, NULL);
 	}
 
 }
@@ -8,95 +8,227 @@
 #include "videojuego.h"
 extern int32_t time_now_ms(void);
 
-static void jugador_remover(struct videojuego *vj)
+/*
+ * Applies a remote player's state sent at envio (in our clock), brought
+ * up to now by dead reckoning. vj->lock must be held.
+ */
+void jugador_actualizar(struct videojuego *vj, uint32_t id,
+		const struct pelota *recibida, int32_t envio,
+		uint64_t puntos, uint64_t choques)
 {
-	struct jugador jugadores_restantes[JUGADORES];
-	return;
-	pthread_mutex_lock(&vj->lock);
-		int l=1;
-		memcpy(&jugadores_restantes[0], &vj->jugadores[0], sizeof(jugadores_restantes[0]));
-		for(int k=1; k < vj->jugadores_len; k++){
-			if(time_now_ms() - vj->jugadores[k].ultimo_ping <= 3000){
-				continue;
-			}
-			fprintf(stderr, "wwwww\n" );
-			memcpy(&jugadores_restantes[l], &vj->jugadores[k], sizeof(jugadores_restantes[l]));
-			l++;
-		}
-		vj->jugadores_len=l;
-		memcpy(&vj->jugadores, &jugadores_restantes, sizeof(jugadores_restantes));
+	struct jugador *j;
+	struct pelota   p = *recibida;
+	int pasos;
 
-	pthread_mutex_unlock(&vj->lock);
+	pasos = (time_now_ms() - envio)/vj->paso_ms;
+	pelota_extrapolar(&p, DR_PASOS_MAX < pasos ? DR_PASOS_MAX:pasos);
+
+	j = jugador_buscar(vj, id);
+	if (NULL == j) {
+		j = jugador_nuevo(vj, id);
+		if (NULL == j)
+			return;
+		fprintf(stderr, "Player 0x%08x added\n", j->id);
+	}
+	p.r = vj->tile_length/4;
+	jugador_pelota_poner(vj, j, &p);
+	j->choques     = choques;
+	j->puntos      = puntos;
+	j->ultimo_ping = time_now_ms();
+	interp_agregar(&j->interp, envio, time_now_ms(), choques, recibida);
 }
 
-static void jugador_agregar(struct videojuego *vj, struct queue_message *qm)
+
+void jugador_agregar(struct videojuego *vj, struct queue_message *qm)
 {
-	int i;
+	struct pelota p = {{0}};
 
-	pthread_mutex_lock(&vj->lock);
+	p.pos.x  = qm->mensaje.datos.jugador.x;
+	p.pos.y  = qm->mensaje.datos.jugador.y;
+	p.dpos.x = qm->mensaje.datos.jugador.dx;
+	p.dpos.y = qm->mensaje.datos.jugador.dy;
 
-	if (JUGADORES <= vj->jugadores_len)
+	/* somebody else drew our player's id, ours moves out of the way */
+	if (vj->jugadores[0].id == qm->mensaje.datos.jugador.id)
+		jugador_renovar(vj, &vj->jugadores[0], &qm->addr);
+
+	jugador_actualizar(vj, qm->mensaje.datos.jugador.id, &p,
+		qm->mensaje.tiempo,
+		qm->mensaje.datos.jugador.puntos,
+		qm->mensaje.datos.jugador.choques);
+}
+
+
+/* one peer sends the map, clients only get it from the server */
+static int mapa_responde(struct videojuego *vj, uint32_t joiner)
+{
+	if (MODO_SERVIDOR == vj->modo)
+		return 1;
+	if (MODO_CLIENTE == vj->modo)
+		return 0;
+	return conexion_responde(vj, joiner);
+}
+
+
+static void mapa_conexion(struct videojuego *vj, struct queue_message *qm)
+{
+	if (!mapa_responde(vj, qm->mensaje.id))
 		return;
+	if (vj->mapa_hash == qm->mensaje.datos.conectar.mapa_hash)
+		mapa_enviar(vj, 0);
+	else
+		mapa_enviar(vj, ~(uint64_t)0);
+}
 
-	for (i = 0; i < vj->jugadores_len; i++) {
-		if (vj->jugadores[i].id != qm->mensaje.datos.jugador.id)
-			continue;
-		vj->jugadores[i].pelota.pos.x = qm->mensaje.datos.jugador.x;
-		vj->jugadores[i].pelota.pos.y = qm->mensaje.datos.jugador.y;
-		vj->jugadores[i].choques      = qm->mensaje.datos.jugador.choques;
-		vj->jugadores[i].puntos       = qm->mensaje.datos.jugador.puntos;
-		vj->jugadores[i].ultimo_ping = time_now_ms();
-
-		pthread_mutex_unlock(&vj->lock);
-		jugador_remover(vj);
+
+void mensaje_registrar(struct videojuego *vj, int tipo,
+		mensaje_manejador fn, int manejo)
+{
+	if (tipo < 0 || MENSAJE_TIPOS <= tipo)
 		return;
+	vj->manejadores[tipo].fn     = fn;
+	vj->manejadores[tipo].manejo = manejo;
+}
+
+
+/*
+ * Handlers of the messages the current mode cares about. Anything that
+ * touches players is deferred, the rest is cheap or has to answer
+ * right away (clock samples, map transfers).
+ */
+void mensajes_iniciar(struct videojuego *vj)
+{
+	mensaje_registrar(vj, MENSAJE_PING,  reloj_ping, MANEJO_INLINE);
+	mensaje_registrar(vj, MENSAJE_PONG,  reloj_pong, MANEJO_INLINE);
+	mensaje_registrar(vj, MENSAJE_CONNECT, mapa_conexion, MANEJO_INLINE);
+	mensaje_registrar(vj, MENSAJE_MAPAS, mapa_recibir, MANEJO_INLINE);
+
+	switch (vj->modo) {
+	case MODO_P2P:
+		mensaje_registrar(vj, MENSAJE_POSICION, jugador_agregar,
+			MANEJO_DIFERIDO);
+		mensaje_registrar(vj, MENSAJE_READY, mundo_enviar,
+			MANEJO_INLINE);
+		mensaje_registrar(vj, MENSAJE_MUNDO, mundo_recibir,
+			MANEJO_DIFERIDO);
+		break;
+	case MODO_SERVIDOR:
+		mensaje_registrar(vj, MENSAJE_ENTRADA, entrada_recibir,
+			MANEJO_DIFERIDO);
+		mensaje_registrar(vj, MENSAJE_READY, mundo_enviar,
+			MANEJO_INLINE);
+		break;
+	case MODO_CLIENTE:
+		mensaje_registrar(vj, MENSAJE_ESTADO, estado_recibir,
+			MANEJO_DIFERIDO);
+		mensaje_registrar(vj, MENSAJE_MUNDO, mundo_recibir,
+			MANEJO_DIFERIDO);
+		break;
+	case MODO_LOCKSTEP:
+		mensaje_registrar(vj, MENSAJE_LOCKSTEP, lockstep_recibir,
+			MANEJO_DIFERIDO);
+		break;
 	}
-	vj->jugadores[i].id           = qm->mensaje.datos.jugador.id;
-	vj->jugadores[i].pelota.r     = vj->jugadores[0].pelota.r;
-	vj->jugadores[i].pelota.pos.x = qm->mensaje.datos.jugador.x;
-	vj->jugadores[i].pelota.pos.y = qm->mensaje.datos.jugador.y;
-	vj->jugadores[i].choques      = qm->mensaje.datos.jugador.choques;
-	vj->jugadores[i].puntos       = qm->mensaje.datos.jugador.puntos;
-	vj->jugadores_len++;
-	fprintf(stderr, "Player %d added\n", vj->jugadores[i].id);
+}
 
-	pthread_mutex_unlock(&vj->lock);
-	jugador_remover(vj);
-	return;
+
+/*
+ * Deferred messages get their tiempo turned into our clock here, while
+ * the connection table is still only touched by recv_thread.
+ */
+static void mensaje_despachar(struct videojuego *vj, struct queue_message *qm)
+{
+	struct mensaje_manejador_registro *h;
+	int32_t offset;
+
+	if (MENSAJE_TIPOS <= qm->mensaje.tipo)
+		return;
+	conexion_evento(vj, qm);
+	h = &vj->manejadores[qm->mensaje.tipo];
+	if (NULL == h->fn)
+		return;
+
+	if (MANEJO_INLINE == h->manejo) {
+		h->fn(vj, qm);
+		return;
+	}
+	if (0 == reloj_offset(vj, qm->mensaje.id, &offset))
+		qm->mensaje.tiempo -= offset;
+	else
+		qm->mensaje.tiempo = time_now_ms();
+	queue_enqueue(vj->queue_diferidos, qm);
 }
 
-static void process_message(struct videojuego *vj, struct queue_message *qm)
+
+/*
+ * Applies every deferred message received so far and expires the
+ * players gone quiet under a single acquisition of vj->lock, called
+ * once per frame or tick.
+ */
+void mensajes_aplicar(struct videojuego *vj)
 {
-	switch (qm->mensaje.tipo) {
-	case MENSAJE_PING:
-		/* send pong */
-		break;
+	struct queue_message qm;
+	mensaje_manejador fn;
+	size_t n = queue_size(vj->queue_diferidos);
 
-	case MENSAJE_PONG:
-		/* update last ping */
-		break;
+	if (!n && !wheel_size(vj->jugadores_temporizadores))
+		return;
 
-	case MENSAJE_CONNECT:
-		/* add player (in connecting) */
-		break;
+	pthread_mutex_lock(&vj->lock);
+	for (; n; n--) {
+		if (-1 == queue_dequeue(vj->queue_diferidos, &qm))
+			break;
+		fn = vj->manejadores[qm.mensaje.tipo].fn;
+		if (NULL != fn)
+			fn(vj, &qm);
+	}
+	jugadores_revisar(vj);
+	pthread_mutex_unlock(&vj->lock);
+}
 
-	case MENSAJE_READY:
-		/* if player has connected, send all info */
-		break;
 
-	case MENSAJE_MAPAS:
-		break;
+/*
+ * Everything a datagram from a peer goes through once it is off the
+ * socket, the replay tool feeds recorded datagrams through here too.
+ */
+void mensaje_recibir(struct videojuego *vj, struct queue_message *qm)
+{
+	struct conexion *c;
+	char phost[46] = {0};
+	char shost[46] = {0};
+	int  pport = 0;
+	int  sport = 0;
 
-	case MENSAJE_MONEDAS:
+	c = conexion_obtener(vj, qm->mensaje.id, &qm->addr);
+	if (NULL == c)
+		return;
+	switch (secuencia_registrar(&c->secuencia, qm->mensaje.seq)) {
+	case SECUENCIA_DUPLICADO:
+		return;
+	case SECUENCIA_ATRASADO:
+		/* a newer position has already been applied */
+		if (MENSAJE_POSICION == qm->mensaje.tipo)
+			return;
 		break;
+	}
 
-	case MENSAJE_POSICION:
-		jugador_agregar(vj, qm);
-		break;
 
-		/* queue_enqueue(vj->queue_fs, op); */
-	}
+	socket_addr_get_ipv4(&qm->addr, phost, sizeof(phost));
+	socket_addr_get_ipv4(&vj->self_addr, shost, sizeof(shost));
+	socket_addr_get_port(&qm->addr, &pport);
+	socket_addr_get_port(&vj->self_addr, &sport);
+	fprintf(stderr,
+		"RECV [%s:%d] <- [%s:%d] "
+		"(0x%08x@%d)\n",
+		shost, sport, phost, pport,
+		qm->mensaje.tipo, qm->mensaje.tiempo);
 
+	if (MENSAJE_ACK == qm->mensaje.tipo)
+		fiable_ack(vj, c, qm);
+	else if (FIABLE_CANAL_NINGUNO != qm->mensaje.canal)
+		fiable_recibir(vj, c, qm, mensaje_despachar);
+	else
+		mensaje_despachar(vj, qm);
 }
 
 
@@ -107,38 +239,24 @@ void* recv_thread(void *param)
 	while (1) {
 		struct queue_message  qm_alloc = {{0}};
 		struct queue_message *qm = &qm_alloc;
-		struct mensaje  m_alloc = {0};
-		struct mensaje *m = &m_alloc;
-		char phost[46] = {0};
-		char shost[46] = {0};
-		int  pport = 0;
-		int  sport = 0;
 		int s;
 
-		s = socket_recvfrom(vj->sock, m, sizeof(*m), &vj->peer_addr);
-		if (-1 == s && EAGAIN == errno){
-			jugador_remover(vj);
-			continue;
-		}
+		fiable_revisar(vj);
+		reloj_revisar(vj);
+		envio_revisar(vj);
+		conexion_revisar(vj);
+		s = socket_recvfrom(vj->sock, &qm->mensaje, sizeof(qm->mensaje),
+			&vj->peer_addr);
 		if (s <= 0)
 			continue;
-		if (m->id == vj->id)
+		/* ours, looped back by the group */
+		if (0 == socket_addr_cmp(&vj->peer_addr, &vj->self_addr))
 			continue;
 
-
-		socket_addr_get_ipv4(&vj->peer_addr, phost, sizeof(phost));
-		socket_addr_get_ipv4(&vj->self_addr, shost, sizeof(shost));
-		socket_addr_get_port(&vj->peer_addr, &pport);
-		socket_addr_get_port(&vj->self_addr, &sport);
-		fprintf(stderr,
-			"RECV [%s:%d] <- [%s:%d] recv %d bytes "
-			"(0x%08x@%d)\n",
-			shost, sport, phost, pport, s,
-			m->tipo, m->tiempo);
-
-		memcpy(&qm->mensaje, m, sizeof(*m));
 		memcpy(&qm->addr, &vj->peer_addr, sizeof(vj->peer_addr));
-		process_message(vj, qm);
+		if (NULL != vj->grabacion)
+			record_append(vj->grabacion, RECORD_RECV, qm, sizeof(*qm));
+		mensaje_recibir(vj, qm);
 	}
 
 	return NULL;
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "videojuego.h"
+extern int32_t time_now_ms(void);
+
+
+/*
+ * Every host multicasts a MENSAJE_PING once per RELOJ_INTERVALO_MS
+ * (faster while some peer has few samples) and every peer answers it
+ * straight to the pinger with a MENSAJE_PONG carrying t1 (ping sent),
+ * t2 (ping received) and, in the header, t3 (pong sent). With t4 (pong
+ * received) that gives
+ *
+ *	offset = ((t2 - t1) + (t3 - t4))/2
+ *	delay  =  (t4 - t1) - (t3 - t2)
+ *
+ * send_thread stamps tiempo on PING/PONG right before sending.
+ */
+
+
+static int32_t abs32(int32_t v)
+{
+	return v < 0 ? -v:v;
+}
+
+
+void reloj_ping(struct videojuego *vj, struct queue_message *qm)
+{
+	struct queue_message  pong_alloc = {{0}};
+	struct queue_message *pong = &pong_alloc;
+
+	pong->mensaje.tipo = MENSAJE_PONG;
+	pong->mensaje.datos.pong.destino = qm->mensaje.id;
+	pong->mensaje.datos.pong.t1 = qm->mensaje.tiempo;
+	pong->mensaje.datos.pong.t2 = time_now_ms();
+	/* only the pinger wants it, the group would get N - 1 of them */
+	memcpy(&pong->addr, &qm->addr, sizeof(pong->addr));
+	queue_enqueue(vj->queue_send, pong);
+}
+
+
+void reloj_pong(struct videojuego *vj, struct queue_message *qm)
+{
+	struct conexion *c;
+	struct reloj    *r;
+	int32_t t1 = qm->mensaje.datos.pong.t1;
+	int32_t t2 = qm->mensaje.datos.pong.t2;
+	int32_t t3 = qm->mensaje.tiempo;
+	int32_t t4 = time_now_ms();
+	int32_t offset;
+	int32_t delay;
+	int     mejor;
+	int     i;
+	int     n;
+
+	if (vj->id != qm->mensaje.datos.pong.destino)
+		return;
+	c = conexion_buscar(vj, qm->mensaje.id);
+	if (NULL == c)
+		return;
+	r = &c->reloj;
+
+	delay  = (t4 - t1) - (t3 - t2);
+	offset = ((t2 - t1) + (t3 - t4))/2;
+	if (delay < 0 || RELOJ_DELAY_MAX < delay)
+		return;
+
+	r->filtro[r->muestras%RELOJ_FILTRO].offset = offset;
+	r->filtro[r->muestras%RELOJ_FILTRO].delay  = delay;
+	r->muestras++;
+	rtt_muestra(&c->rtt, delay);
+
+	n = r->muestras < RELOJ_FILTRO ? r->muestras:RELOJ_FILTRO;
+	mejor = 0;
+	for (i = 1; i < n; i++)
+		if (r->filtro[i].delay < r->filtro[mejor].delay)
+			mejor = i;
+	offset = r->filtro[mejor].offset;
+
+	if (1 == r->muestras) {
+		r->offset = offset;
+		r->jitter = delay/2;
+		return;
+	}
+	r->jitter += (abs32(offset - r->offset) - r->jitter)/4;
+	r->offset += (offset - r->offset)/4;
+}
+
+
+void reloj_revisar(struct videojuego *vj)
+{
+	struct queue_message  qm_alloc = {{0}};
+	struct queue_message *qm = &qm_alloc;
+	int32_t intervalo = RELOJ_INTERVALO_MS;
+	size_t  i;
+
+	for (i = 0; i < vj->conexiones_len; i++)
+		if (vj->conexiones[i]->reloj.muestras < RELOJ_FILTRO/2)
+			intervalo = RELOJ_INICIO_MS;
+	if (time_now_ms() - vj->reloj_ping < intervalo)
+		return;
+	vj->reloj_ping = time_now_ms();
+
+	qm->mensaje.tipo = MENSAJE_PING;
+	memcpy(&qm->addr, &vj->group_addr, sizeof(qm->addr));
+	queue_enqueue(vj->queue_send, qm);
+}
+
+
+int reloj_offset(struct videojuego *vj, uint32_t id, int32_t *offset)
+{
+	struct conexion *c;
+
+	c = conexion_buscar(vj, id);
+	if (NULL == c || 0 == c->reloj.muestras)
+		return -1;
+	*offset = c->reloj.offset;
+	return 0;
+}
+
+
+int reloj_rtt(struct videojuego *vj, uint32_t id, int32_t *rtt)
+{
+	struct conexion *c;
+
+	c = conexion_buscar(vj, id);
+	if (NULL == c || 0 == c->rtt.muestras)
+		return -1;
+	*rtt = c->rtt.srtt;
+	return 0;
+}
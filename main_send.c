@@ -3,6 +3,7 @@
 #include <string.h>
 
 #include "videojuego.h"
+extern int32_t time_now_ms(void);
 
 
 void* send_thread(void *param)
@@ -24,16 +25,22 @@ void* send_thread(void *param)
 			return NULL;
 
 
-		qm->mensaje.id = vj->id;
-		s = socket_sendto(vj->sock, qm, sizeof(*qm), &vj->group_addr);
+		qm->mensaje.id  = __atomic_load_n(&vj->id, __ATOMIC_RELAXED);
+		qm->mensaje.seq = ++vj->seq;
+		if (MENSAJE_PING == qm->mensaje.tipo
+		||  MENSAJE_PONG == qm->mensaje.tipo)
+			qm->mensaje.tiempo = time_now_ms();
+		s = socket_sendto(vj->sock, qm, sizeof(*qm), &qm->addr);
 		if (-1 == s) {
 			perror("socket_sendto");
 			continue;
 		}
+		if (NULL != vj->grabacion)
+			record_append(vj->grabacion, RECORD_SEND, qm, sizeof(*qm));
 
-		socket_addr_get_ipv4(&vj->group_addr, phost, sizeof(phost));
+		socket_addr_get_ipv4(&qm->addr, phost, sizeof(phost));
 		socket_addr_get_ipv4(&vj->self_addr, shost, sizeof(shost));
-		socket_addr_get_port(&vj->group_addr, &pport);
+		socket_addr_get_port(&qm->addr, &pport);
 		socket_addr_get_port(&vj->self_addr, &sport);
 		fprintf(stderr,
 			"SEND [%s:%d] -> [%s:%d] sent "
@@ -0,0 +1,580 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "videojuego.h"
+
+#define PIXEL_SPEED    (4)
+#define PIXEL_DISTANCE (1)
+#define FRICCION_NUM   (95)
+#define FRICCION_DEN   (100)
+
+
+/* set by the replay tool, the game then runs on the recorded clock */
+static int32_t reloj_fijo;
+static int     reloj_fijado;
+
+
+int32_t time_now_ms(void)
+{
+	struct timespec spec;
+	long            ms;
+	time_t          s;
+
+	if (reloj_fijado)
+		return reloj_fijo;
+
+	clock_gettime(CLOCK_REALTIME, &spec);
+
+	s  = spec.tv_sec;
+	ms = round(spec.tv_nsec/1.0e6);
+
+	return s*1000 + ms;
+}
+
+
+void time_set_ms(int32_t ms)
+{
+	reloj_fijo   = ms;
+	reloj_fijado = 1;
+}
+
+
+/*
+ * Integer only, so every peer of a lockstep match computes the same
+ * ball: the friction of 0.95 is done as a multiply and a truncating
+ * divide.
+ */
+void pelota_paso(struct pelota *p)
+{
+	p->pos.x  += p->dpos.x;
+	p->dpos.x  = p->dpos.x*FRICCION_NUM/FRICCION_DEN;
+	p->pos.y  += p->dpos.y;
+	p->dpos.y  = p->dpos.y*FRICCION_NUM/FRICCION_DEN;
+}
+
+
+void pelota_extrapolar(struct pelota *p, int pasos)
+{
+	for (; 0 < pasos && (p->dpos.x || p->dpos.y); pasos--)
+		pelota_paso(p);
+}
+
+
+/* vj->lock must be held by these three */
+struct jugador* jugador_buscar(struct videojuego *vj, uint32_t id)
+{
+	size_t i;
+
+	if (-1 == idmap_get(vj->jugadores_indice, id, &i))
+		return NULL;
+	return &vj->jugadores[i];
+}
+
+
+/*
+ * Players not heard from in JUGADOR_INACTIVO_MS leave the table. Packets
+ * only touch ultimo_ping, the timer catches up when it fires, so only
+ * the players that really expired cost anything. The timers live apart
+ * from the table, which moves, and in vj->jugadores_temporizadores,
+ * used under vj->lock by the thread applying deferred messages. Our
+ * own player and lockstep players stay for good.
+ */
+struct jugador_temporizador {
+	struct wheel_node nodo;
+	uint32_t          id;
+};
+
+
+static void jugador_vencido(struct wheel_node *n, void *arg)
+{
+	struct videojuego *vj = arg;
+	struct jugador_temporizador *t = n->data;
+	struct jugador *j;
+	int32_t ahora = time_now_ms();
+
+	/* a player removed some other way, or back with a timer of its own */
+	j = jugador_buscar(vj, t->id);
+	if (NULL == j || j->temporizador != t) {
+		free(t);
+		return;
+	}
+	if (ahora - j->ultimo_ping < JUGADOR_INACTIVO_MS) {
+		wheel_add(vj->jugadores_temporizadores, n,
+			j->ultimo_ping + JUGADOR_INACTIVO_MS);
+		return;
+	}
+	fprintf(stderr, "Player 0x%08x left\n", j->id);
+	jugador_quitar(vj, j - vj->jugadores);
+}
+
+
+/* vj->lock must be held */
+void jugadores_revisar(struct videojuego *vj)
+{
+	wheel_advance(vj->jugadores_temporizadores, time_now_ms(),
+		jugador_vencido, vj);
+}
+
+
+/* may move the table, pointers to other players are stale afterwards */
+struct jugador* jugador_nuevo(struct videojuego *vj, uint32_t id)
+{
+	struct jugador_temporizador *t = NULL;
+	struct jugador *j;
+	size_t cap;
+
+	if (vj->jugadores_len == vj->jugadores_cap) {
+		cap = vj->jugadores_cap ? 2*vj->jugadores_cap:JUGADORES;
+		j = realloc(vj->jugadores, cap*sizeof(*j));
+		if (NULL == j)
+			return NULL;
+		vj->jugadores     = j;
+		vj->jugadores_cap = cap;
+	}
+	if ((vj->jugadores_len || MODO_SERVIDOR == vj->modo)
+	&&  MODO_LOCKSTEP != vj->modo) {
+		t = calloc(1, sizeof(*t));
+		if (NULL == t)
+			return NULL;
+	}
+	if (-1 == bodies_push(vj->pelotas)) {
+		free(t);
+		return NULL;
+	}
+	if (-1 == idmap_put(vj->jugadores_indice, id, vj->jugadores_len)) {
+		bodies_remove(vj->pelotas, vj->jugadores_len);
+		free(t);
+		return NULL;
+	}
+
+	j = &vj->jugadores[vj->jugadores_len++];
+	memset(j, 0, sizeof(*j));
+	j->id = id;
+	j->ultimo_ping = time_now_ms();
+	if (NULL != t) {
+		t->id = id;
+		t->nodo.data = t;
+		wheel_add(vj->jugadores_temporizadores, &t->nodo,
+			j->ultimo_ping + JUGADOR_INACTIVO_MS);
+		j->temporizador = t;
+	}
+	return j;
+}
+
+
+/* the last player takes the freed slot */
+void jugador_quitar(struct videojuego *vj, size_t i)
+{
+	struct jugador_temporizador *t = vj->jugadores[i].temporizador;
+	size_t ultimo = vj->jugadores_len - 1;
+
+	if (NULL != t) {
+		wheel_remove(vj->jugadores_temporizadores, &t->nodo);
+		free(t);
+	}
+	idmap_remove(vj->jugadores_indice, vj->jugadores[i].id);
+	if (i != ultimo) {
+		vj->jugadores[i] = vj->jugadores[ultimo];
+		idmap_put(vj->jugadores_indice, vj->jugadores[i].id, i);
+	}
+	bodies_remove(vj->pelotas, i);
+	vj->jugadores_len--;
+}
+
+
+/* a player of ours whose id turned out to be taken, no timer to move */
+void jugador_renovar(struct videojuego *vj, struct jugador *j,
+		const struct socket_addr *addr)
+{
+	uint32_t id = j->id;
+
+	do {
+		id = id_renovar(id, addr);
+	} while (NULL != jugador_buscar(vj, id));
+
+	fprintf(stderr, "Player 0x%08x taken, now 0x%08x\n", j->id, id);
+	idmap_remove(vj->jugadores_indice, j->id);
+	idmap_put(vj->jugadores_indice, id, j - vj->jugadores);
+	j->id = id;
+}
+
+
+/*
+ * The balls of the players in the table live apart in vj->pelotas, so
+ * stepping them all does not drag the rest of every player through the
+ * cache. vj->lock must be held.
+ */
+struct pelota jugador_pelota(struct videojuego *vj, const struct jugador *j)
+{
+	struct pelota p = {{0}};
+	size_t i = j - vj->jugadores;
+
+	p.pos.x  = vj->pelotas->x[i];
+	p.pos.y  = vj->pelotas->y[i];
+	p.dpos.x = vj->pelotas->dx[i];
+	p.dpos.y = vj->pelotas->dy[i];
+	p.r      = vj->pelotas->r[i];
+	return p;
+}
+
+
+void jugador_pelota_poner(struct videojuego *vj, const struct jugador *j,
+		const struct pelota *p)
+{
+	size_t i = j - vj->jugadores;
+
+	vj->pelotas->x[i]  = p->pos.x;
+	vj->pelotas->y[i]  = p->pos.y;
+	vj->pelotas->dx[i] = p->dpos.x;
+	vj->pelotas->dy[i] = p->dpos.y;
+	vj->pelotas->r[i]  = p->r;
+}
+
+
+/*
+ * Remote players are stepped too, with the velocity they last sent,
+ * so they keep moving between updates. A client's own ball only moves
+ * through pelota_simular, once per input.
+ */
+void update_jugadores(struct videojuego *vj)
+{
+	pthread_mutex_lock(&vj->lock);
+	bodies_step(vj->pelotas, MODO_CLIENTE == vj->modo,
+		FRICCION_NUM, FRICCION_DEN);
+	pthread_mutex_unlock(&vj->lock);
+}
+
+
+/*
+ * Swept collision against the maze. The ball is the square of half side
+ * r around its centre, so it is inside a wall tile when the centre is
+ * strictly inside the tile grown by r on every side. A move goes from
+ * desde to p->pos; the centre's path is walked tile by tile (Amanatides
+ * and Woo), and the walls around each tile it crosses are tested.
+ * The walk stops once the crossings get past the earliest hit found.
+ * Times are fractions of the move compared by cross-multiplying, so
+ * every peer of a lockstep match gets the same answer.
+ */
+struct fraccion {
+	int64_t num;
+	int64_t den;  /* > 0 */
+};
+
+
+static int fraccion_menor(struct fraccion a, struct fraccion b)
+{
+	return a.num*b.den < b.num*a.den;
+}
+
+
+/* when the centre a moving by d is within (lo, hi) on one axis */
+static int barrer_eje(int a, int d, int lo, int hi,
+		struct fraccion *entra, struct fraccion *sale)
+{
+	if (0 == d) {
+		*entra = (struct fraccion){-1, 1};
+		*sale  = (struct fraccion){ 2, 1};
+		return lo < a && a < hi;
+	}
+	if (0 < d) {
+		*entra = (struct fraccion){lo - a, d};
+		*sale  = (struct fraccion){hi - a, d};
+	} else {
+		*entra = (struct fraccion){a - hi, -d};
+		*sale  = (struct fraccion){a - lo, -d};
+	}
+	return 1;
+}
+
+
+/* a hit on the wall at tile (i, j) earlier than *t moves *t and *im */
+static void barrer_pared(struct videojuego *vj, int i, int j,
+		const struct pos *a, const struct pos *d, int r,
+		struct fraccion *t, struct impacto *im)
+{
+	struct fraccion ex;
+	struct fraccion sx;
+	struct fraccion ey;
+	struct fraccion sy;
+	struct fraccion entra = {0, 1};
+	struct fraccion sale  = {1, 1};
+	int l = vj->tile_length;
+
+	if (!barrer_eje(a->x, d->x, j*l - r, (j + 1)*l + r, &ex, &sx)
+	||  !barrer_eje(a->y, d->y, i*l - r, (i + 1)*l + r, &ey, &sy))
+		return;
+	if (fraccion_menor(entra, ex))
+		entra = ex;
+	if (fraccion_menor(entra, ey))
+		entra = ey;
+	if (fraccion_menor(sx, sale))
+		sale = sx;
+	if (fraccion_menor(sy, sale))
+		sale = sy;
+	if (!fraccion_menor(entra, sale) || fraccion_menor(*t, entra))
+		return;
+
+	/* walls hit at once add up their faces, whatever order they came in */
+	if (fraccion_menor(entra, *t)) {
+		*t = entra;
+		im->t = entra.num*IMPACTO_UNO/entra.den;
+		im->normal.x = 0;
+		im->normal.y = 0;
+	}
+
+	/* the face is on the axis entered last, both at a corner */
+	if (d->x && !fraccion_menor(ex, entra))
+		im->normal.x = 0 < d->x ? -1:1;
+	if (d->y && !fraccion_menor(ey, entra))
+		im->normal.y = 0 < d->y ? -1:1;
+}
+
+
+/* the walls around tile (i, j) the ball can touch with its centre there */
+static void barrer_celda(struct videojuego *vj, int i, int j,
+		const struct pos *a, const struct pos *d, int r,
+		struct fraccion *t, struct impacto *im)
+{
+	int ylen = tilemap_height(vj->mapa);
+	int xlen = tilemap_width(vj->mapa);
+	int k = r/vj->tile_length + 1;
+	int i0 = 0 < i - k ? i - k:0;
+	int j0 = 0 < j - k ? j - k:0;
+	int i1 = i + k < ylen ? i + k:ylen - 1;
+	int j1 = j + k < xlen ? j + k:xlen - 1;
+	uint64_t fila;
+	int y;
+	int x;
+	int b;
+
+	for (y = i0; y <= i1; y++)
+	for (x = j0; x <= j1; x += 64) {
+		fila = tilemap_row(vj->mapa, x, y, j1 - x < 64 ? j1 - x + 1:64);
+		for (b = 0; fila; b++, fila >>= 1)
+			if (fila & 1)
+				barrer_pared(vj, y, x + b, a, d, r, t, im);
+	}
+}
+
+
+static int piso(int a, int l)
+{
+	return a < 0 ? -((l - 1 - a)/l):a/l;
+}
+
+
+/*
+ * Returns -1 when the move from desde to p->pos runs into a wall, with
+ * how much of it was done and the face it hit in *im if not NULL. A
+ * ball starting inside a wall hits at 0 with no normal.
+ */
+int pelota_barrer(struct videojuego *vj, const struct pos *desde,
+		const struct pelota *p, struct impacto *im)
+{
+	struct impacto  im_alloc;
+	struct fraccion t = {1, 1};
+	struct fraccion tx;
+	struct fraccion ty;
+	struct pos d = {p->pos.x - desde->x, p->pos.y - desde->y};
+	int l = vj->tile_length;
+	int k = p->r/l + 1;
+	int ylen = tilemap_height(vj->mapa);
+	int xlen = tilemap_width(vj->mapa);
+	int i = piso(desde->y, l);
+	int j = piso(desde->x, l);
+	int si = (0 < d.y) - (d.y < 0);
+	int sj = (0 < d.x) - (d.x < 0);
+
+	if (NULL == im)
+		im = &im_alloc;
+
+	/* when the centre crosses into the next column and row */
+	tx = (struct fraccion){0 < sj ? (j + 1)*l - desde->x:desde->x - j*l,
+		sj ? sj*d.x:1};
+	ty = (struct fraccion){0 < si ? (i + 1)*l - desde->y:desde->y - i*l,
+		si ? si*d.y:1};
+	if (!sj)
+		tx.num = 2;
+	if (!si)
+		ty.num = 2;
+
+	while (1) {
+		barrer_celda(vj, i, j, desde, &d, p->r, &t, im);
+
+		/* past the end of the move, an earlier hit or the map */
+		if (fraccion_menor(ty, tx)) {
+			if (fraccion_menor(t, ty) || (0 < si && ylen + k <= i)
+			||  (si < 0 && i < -k))
+				break;
+			i += si;
+			ty.num += l;
+		} else {
+			if (fraccion_menor(t, tx) || (0 < sj && xlen + k <= j)
+			||  (sj < 0 && j < -k))
+				break;
+			j += sj;
+			tx.num += l;
+		}
+	}
+	return fraccion_menor(t, (struct fraccion){1, 1}) ? -1:0;
+}
+
+
+void pelota_entrada(struct pelota *p, int teclas)
+{
+	if (teclas & ENTRADA_IZQUIERDA) {
+		p->dpos.x -= PIXEL_SPEED;
+		p->pos.x  -= PIXEL_DISTANCE;
+	}
+	if (teclas & ENTRADA_ARRIBA) {
+		p->dpos.y -= PIXEL_SPEED;
+		p->pos.y  -= PIXEL_DISTANCE;
+	}
+	if (teclas & ENTRADA_DERECHA) {
+		p->dpos.x += PIXEL_SPEED;
+		p->pos.x  += PIXEL_DISTANCE;
+	}
+	if (teclas & ENTRADA_ABAJO) {
+		p->dpos.y += PIXEL_SPEED;
+		p->pos.y  += PIXEL_DISTANCE;
+	}
+}
+
+
+void pelota_reiniciar(struct videojuego *vj, struct pelota *p)
+{
+	p->r      = vj->tile_length/4;
+	p->pos.x  = vj->tile_length/2;
+	p->pos.y  = vj->tile_length/2;
+	p->dpos.x = 0;
+	p->dpos.y = 0;
+}
+
+
+void jugador_reiniciar(struct videojuego *vj, struct jugador *j)
+{
+	struct pelota p = {{0}};
+
+	pelota_reiniciar(vj, &p);
+	jugador_pelota_poner(vj, j, &p);
+}
+
+
+/*
+ * One input worth of movement. It only depends on the ball, the keys
+ * and the map, so the server runs it once per input and a client can
+ * re-run it over the inputs the server has not applied yet. Returns -1
+ * when the ball hit a wall and went back to the start.
+ */
+int pelota_simular(struct videojuego *vj, struct pelota *p, int teclas)
+{
+	struct pos desde = p->pos;
+
+	pelota_entrada(p, teclas);
+	pelota_paso(p);
+	if (-1 == pelota_barrer(vj, &desde, p, NULL)) {
+		pelota_reiniciar(vj, p);
+		return -1;
+	}
+	return 0;
+}
+
+
+static void jugador_puntuar(struct jugador *j, int32_t ahora)
+{
+	if (ahora - j->ultimo_movimiento < 300)
+		j->puntos++;
+	if (1000 < ahora - j->ultimo_movimiento && j->puntos)
+		j->puntos--;
+}
+
+
+/*
+ * Crash and scoring rules for a player whose ball p just moved from
+ * desde, returns -1 when the player hit a wall on the way and was sent
+ * back to the start.
+ */
+int jugador_simular(struct videojuego *vj, struct jugador *j,
+		const struct pos *desde, struct pelota *p, int32_t ahora)
+{
+	if (-1 == pelota_barrer(vj, desde, p, NULL)) {
+		j->choques++;
+		j->puntos = 0;
+		pelota_reiniciar(vj, p);
+		return -1;
+	}
+
+	jugador_puntuar(j, ahora);
+	return 0;
+}
+
+
+/*
+ * Inputs of a remote player waiting for the next tick, every input is
+ * one simulation step. Inputs lost beyond the message redundancy are
+ * taken as empty.
+ */
+void jugador_entrada_recibir(struct jugador *j, uint32_t seq,
+		const uint8_t *teclas, int n)
+{
+	uint32_t q;
+
+	if (0 <= (int32_t)(j->entrada_recibida - seq))
+		return;
+	if (ENTRADA_COLA < seq - j->entrada_aplicada)
+		j->entrada_aplicada = seq - ENTRADA_COLA;
+	if (0 < (int32_t)(j->entrada_aplicada - j->entrada_recibida))
+		j->entrada_recibida = j->entrada_aplicada;
+
+	for (q = j->entrada_recibida + 1; q != seq + 1; q++)
+		j->entradas[q%ENTRADA_COLA] = seq - q < (uint32_t)n
+			? teclas[n - 1 - (seq - q)]:0;
+	j->entrada_recibida = seq;
+}
+
+
+/*
+ * A player's input applied with crashes and scoring, ahora only feeds
+ * the scoring so lockstep passes its tick time.
+ */
+int jugador_paso(struct videojuego *vj, struct jugador *j, int teclas,
+		int32_t ahora)
+{
+	struct pelota p = jugador_pelota(vj, j);
+	int s = 0;
+
+	if (teclas)
+		j->ultimo_movimiento = ahora;
+	if (-1 == pelota_simular(vj, &p, teclas)) {
+		j->choques++;
+		j->puntos = 0;
+		s = -1;
+	} else {
+		jugador_puntuar(j, ahora);
+	}
+	jugador_pelota_poner(vj, j, &p);
+	return s;
+}
+
+
+int jugador_entrada_aplicar(struct videojuego *vj, struct jugador *j,
+		int32_t ahora)
+{
+	uint8_t teclas;
+	int n;
+
+	for (n = 0; n < ENTRADA_POR_TICK; n++) {
+		if (j->entrada_aplicada == j->entrada_recibida)
+			break;
+		j->entrada_aplicada++;
+		teclas = j->entradas[j->entrada_aplicada%ENTRADA_COLA];
+		jugador_paso(vj, j, teclas, ahora);
+	}
+
+	return n;
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "videojuego.h"
+
+
+/*
+ * Frames draw from one of three views handed around by vj->vistas_tb:
+ * the simulating thread fills the back one under vj->lock and publishes
+ * it, the render loop takes the newest published one without locking
+ * and keeps drawing it until a newer one shows up. Remote players are
+ * placed here, at their interpolated position for ahora, and the ones
+ * about to expire are left out. Without previa our ball is drawn
+ * where it is.
+ *
+ * Only the map under the screen goes in the view, as the wall rows of
+ * the tiles both cameras (at previa and where our ball is now) can see,
+ * and players away from them are left out too, so drawing a frame costs
+ * the same on any map.
+ */
+
+
+void vista_camara(struct videojuego *vj, const struct vista *v,
+		const struct pos *centro, struct pos *camara)
+{
+	int32_t xmax = v->mapa_xlen*vj->tile_length - vj->width;
+	int32_t ymax = v->mapa_ylen*vj->tile_length - vj->height;
+
+	camara->x = centro->x - vj->width/2;
+	camara->y = centro->y - vj->height/2;
+	if (xmax < camara->x)
+		camara->x = xmax;
+	if (ymax < camara->y)
+		camara->y = ymax;
+	if (camara->x < 0)
+		camara->x = 0;
+	if (camara->y < 0)
+		camara->y = 0;
+}
+
+
+/* the tiles seen from both cameras, -1 past what a view can hold */
+static int vista_ventana(struct videojuego *vj, struct vista *v,
+		const struct pos *a, const struct pos *b)
+{
+	struct pos ca;
+	struct pos cb;
+	int32_t l = vj->tile_length;
+	int32_t x1;
+	int32_t y1;
+
+	vista_camara(vj, v, a, &ca);
+	vista_camara(vj, v, b, &cb);
+	v->x0 = (ca.x < cb.x ? ca.x:cb.x)/l;
+	v->y0 = (ca.y < cb.y ? ca.y:cb.y)/l;
+	x1 = ((ca.x < cb.x ? cb.x:ca.x) + vj->width - 1)/l;
+	y1 = ((ca.y < cb.y ? cb.y:ca.y) + vj->height - 1)/l;
+	if (v->mapa_xlen <= x1)
+		x1 = v->mapa_xlen - 1;
+	if (v->mapa_ylen <= y1)
+		y1 = v->mapa_ylen - 1;
+	v->xlen = x1 - v->x0 + 1;
+	v->ylen = y1 - v->y0 + 1;
+
+	return 64 < v->xlen || VISTA_FILAS < v->ylen ? -1:0;
+}
+
+
+void vista_publicar(struct videojuego *vj, const struct pos *previa,
+		int32_t ahora)
+{
+	struct vista *v = &vj->vistas[tribuf_back(vj->vistas_tb)];
+	struct vista_jugador *vjug;
+	struct jugador *j;
+	struct pos pos = {0};
+	int32_t x0;
+	int32_t y0;
+	int32_t x1;
+	int32_t y1;
+	size_t cap;
+	size_t i;
+	int y;
+
+	pthread_mutex_lock(&vj->lock);
+	if (v->cap < vj->jugadores_len) {
+		cap  = vj->jugadores_cap;
+		vjug = realloc(v->jugadores, cap*sizeof(*vjug));
+		if (NULL == vjug) {
+			/* frames keep the last view */
+			pthread_mutex_unlock(&vj->lock);
+			perror("vista_publicar");
+			return;
+		}
+		v->jugadores = vjug;
+		v->cap = cap;
+	}
+
+	if (0 < vj->jugadores_len) {
+		pos.x = vj->pelotas->x[0];
+		pos.y = vj->pelotas->y[0];
+	}
+	v->previa = NULL != previa ? *previa:pos;
+	v->tiempo = ahora;
+	v->mapa_xlen = tilemap_width(vj->mapa);
+	v->mapa_ylen = tilemap_height(vj->mapa);
+	if (-1 == vista_ventana(vj, v, &v->previa, &pos)) {
+		/* too far to draw the way there, jump */
+		v->previa = pos;
+		vista_ventana(vj, v, &pos, &pos);
+	}
+	for (y = 0; y < v->ylen; y++)
+		v->paredes[y] = tilemap_row(vj->mapa, v->x0, v->y0 + y, v->xlen);
+
+	x0 = v->x0*vj->tile_length;
+	y0 = v->y0*vj->tile_length;
+	x1 = (v->x0 + v->xlen)*vj->tile_length;
+	y1 = (v->y0 + v->ylen)*vj->tile_length;
+
+	v->len = 0;
+	for (i = 0; i < vj->jugadores_len; i++) {
+		j = &vj->jugadores[i];
+		if (0 != i && JUGADOR_INACTIVO_MS <= ahora - j->ultimo_ping)
+			continue;
+
+		vjug = &v->jugadores[v->len];
+		vjug->id      = j->id;
+		vjug->pos.x   = vj->pelotas->x[i];
+		vjug->pos.y   = vj->pelotas->y[i];
+		vjug->r       = vj->pelotas->r[i];
+		vjug->puntos  = j->puntos;
+		vjug->choques = j->choques;
+		if (0 != i && MODO_LOCKSTEP != vj->modo)
+			interp_posicion(&j->interp, ahora, vj->paso_ms, &vjug->pos);
+		if (0 != i
+		&& (vjug->pos.x + 2*vjug->r < x0 || x1 + vjug->r <= vjug->pos.x
+		||  vjug->pos.y + 2*vjug->r < y0 || y1 + vjug->r <= vjug->pos.y))
+			continue;
+		v->len++;
+	}
+	pthread_mutex_unlock(&vj->lock);
+
+	tribuf_publish(vj->vistas_tb);
+}
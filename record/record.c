@@ -0,0 +1,496 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#include "record.h"
+
+
+/*
+ * The log starts with a struct header followed by one entry per
+ * datagram:
+ *
+ *     varint  milliseconds since the previous entry
+ *     byte    direction (0 marks the end of the log)
+ *     varint  length of the datagram
+ *     ...     runs of (varint n, n literal bytes, varint zeros)
+ *
+ * Datagrams are mostly zeroed structs, so dropping the zero runs keeps
+ * hours of play small. Every RECORD_INDEX_MS the time and offset of an
+ * entry go to PATH.idx, which is what seeking bisects.
+ */
+
+
+#define RECORD_MAGIC   (0x44434552) /* "RECD" */
+#define RECORD_VERSION (1)
+#define RECORD_GROW    (1 << 20)
+
+
+struct header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t tag;
+	uint32_t id;
+	int64_t  start_ms;
+};
+
+
+struct index {
+	uint64_t time_ms;
+	uint64_t offset;
+};
+
+
+struct map {
+	int      fd;
+	uint8_t *bytes;
+	size_t   len;
+	size_t   size;
+};
+
+
+struct record {
+	pthread_mutex_t lock;
+	struct map      log;
+	struct map      idx;
+	uint64_t        start;
+	uint64_t        last;
+	uint64_t        indexed;
+	int             entries;
+};
+
+
+struct record_reader {
+	struct header  *header;
+	uint8_t        *log;
+	size_t          loglen;
+	struct index   *idx;
+	size_t          idxlen;
+	size_t          idxsize;
+	size_t          offset;
+	uint64_t        time_ms;
+	uint8_t         buf[RECORD_MAX];
+};
+
+
+static uint64_t clock_ms(clockid_t clock)
+{
+	struct timespec spec;
+
+	clock_gettime(clock, &spec);
+	return (uint64_t)spec.tv_sec*1000 + spec.tv_nsec/1000000;
+}
+
+
+static size_t varint_put(uint8_t *p, uint64_t v)
+{
+	size_t n = 0;
+
+	while (0x80 <= v) {
+		p[n++] = 0x80 | (v & 0x7f);
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+
+
+static int varint_get(const uint8_t *p, size_t len, size_t *off,
+		uint64_t *v)
+{
+	int shift = 0;
+
+	*v = 0;
+	while (*off < len && shift < 64) {
+		*v |= (uint64_t)(p[*off] & 0x7f) << shift;
+		if (!(p[(*off)++] & 0x80))
+			return 0;
+		shift += 7;
+	}
+	return -1;
+}
+
+
+static int map_open(struct map *m, const char *path)
+{
+	m->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (-1 == m->fd)
+		return -1;
+	m->bytes = NULL;
+	m->len   = 0;
+	m->size  = 0;
+	return 0;
+}
+
+
+static int map_reserve(struct map *m, size_t len)
+{
+	uint8_t *p;
+	size_t size = m->size;
+
+	if (m->len + len <= m->size)
+		return 0;
+	while (size < m->len + len)
+		size += RECORD_GROW;
+
+	if (-1 == ftruncate(m->fd, size))
+		return -1;
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+	if (MAP_FAILED == p)
+		return -1;
+	if (NULL != m->bytes)
+		munmap(m->bytes, m->size);
+	m->bytes = p;
+	m->size  = size;
+	return 0;
+}
+
+
+static void map_close(struct map *m)
+{
+	if (NULL != m->bytes)
+		munmap(m->bytes, m->size);
+	if (-1 != m->fd) {
+		if (-1 == ftruncate(m->fd, m->len))
+			perror("ftruncate");
+		close(m->fd);
+	}
+	m->bytes = NULL;
+	m->fd    = -1;
+}
+
+
+record* record_open(const char *path, uint32_t tag, uint32_t id)
+{
+	struct header h = {0};
+	record *r;
+	char   *idxpath;
+
+	assert(NULL != path && "path cannot be NULL");
+
+	r = calloc(1, sizeof(*r));
+	idxpath = malloc(strlen(path) + sizeof(".idx"));
+	if (NULL == r || NULL == idxpath) {
+		perror("record");
+		free(idxpath);
+		free(r);
+		return NULL;
+	}
+	sprintf(idxpath, "%s.idx", path);
+
+	r->log.fd = -1;
+	r->idx.fd = -1;
+	if (-1 == map_open(&r->log, path)
+	||  -1 == map_open(&r->idx, idxpath)
+	||  -1 == map_reserve(&r->log, sizeof(h))) {
+		perror(path);
+		map_close(&r->log);
+		map_close(&r->idx);
+		free(idxpath);
+		free(r);
+		return NULL;
+	}
+	free(idxpath);
+
+	h.magic    = RECORD_MAGIC;
+	h.version  = RECORD_VERSION;
+	h.tag      = tag;
+	h.id       = id;
+	h.start_ms = clock_ms(CLOCK_REALTIME);
+	memcpy(r->log.bytes, &h, sizeof(h));
+	r->log.len = sizeof(h);
+
+	r->start = clock_ms(CLOCK_MONOTONIC);
+	pthread_mutex_init(&r->lock, NULL);
+	return r;
+}
+
+
+int record_close(record *r)
+{
+	if (NULL == r)
+		return 0;
+	pthread_mutex_lock(&r->lock);
+	map_close(&r->log);
+	map_close(&r->idx);
+	pthread_mutex_unlock(&r->lock);
+	pthread_mutex_destroy(&r->lock);
+	free(r);
+	return 0;
+}
+
+
+int record_append(record *r, int direction, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	struct index  ix;
+	uint8_t *out;
+	uint64_t now;
+	size_t   n = 0;
+	size_t   i = 0;
+	size_t   lit;
+	size_t   zeros;
+
+	assert(NULL != r && "r cannot be NULL");
+	assert((RECORD_RECV == direction || RECORD_SEND == direction)
+		&& "direction must be RECORD_RECV or RECORD_SEND");
+
+	if (RECORD_MAX < len)
+		return -1;
+
+	pthread_mutex_lock(&r->lock);
+	/* worst case is a zero every other byte, 3 bytes for each pair */
+	if (-1 == map_reserve(&r->log, 32 + 2*len)) {
+		pthread_mutex_unlock(&r->lock);
+		return -1;
+	}
+
+	now = clock_ms(CLOCK_MONOTONIC) - r->start;
+	if (now < r->last)
+		now = r->last;
+
+	if (!r->entries || RECORD_INDEX_MS <= now - r->indexed) {
+		ix.time_ms = now;
+		ix.offset  = r->log.len;
+		if (0 == map_reserve(&r->idx, sizeof(ix))) {
+			memcpy(r->idx.bytes + r->idx.len, &ix, sizeof(ix));
+			r->idx.len += sizeof(ix);
+			r->indexed = now;
+		}
+	}
+
+	out = r->log.bytes + r->log.len;
+	n += varint_put(out + n, now - r->last);
+	out[n++] = direction;
+	n += varint_put(out + n, len);
+	while (i < len) {
+		for (lit = 0; i + lit < len && p[i + lit]; lit++)
+			;
+		n += varint_put(out + n, lit);
+		memcpy(out + n, p + i, lit);
+		n += lit;
+		i += lit;
+
+		for (zeros = 0; i + zeros < len && !p[i + zeros]; zeros++)
+			;
+		n += varint_put(out + n, zeros);
+		i += zeros;
+	}
+
+	r->log.len += n;
+	r->last = now;
+	r->entries++;
+	pthread_mutex_unlock(&r->lock);
+	return 0;
+}
+
+
+static void* map_read(const char *path, size_t *len)
+{
+	struct stat st;
+	void *p;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (-1 == fd)
+		return NULL;
+	if (-1 == fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		return NULL;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == p)
+		return NULL;
+	*len = st.st_size;
+	return p;
+}
+
+
+record_reader* record_reader_open(const char *path)
+{
+	record_reader *r;
+	char  *idxpath;
+	size_t n;
+
+	assert(NULL != path && "path cannot be NULL");
+
+	r = calloc(1, sizeof(*r));
+	idxpath = malloc(strlen(path) + sizeof(".idx"));
+	if (NULL == r || NULL == idxpath) {
+		perror("record_reader");
+		free(idxpath);
+		free(r);
+		return NULL;
+	}
+	sprintf(idxpath, "%s.idx", path);
+
+	r->log = map_read(path, &r->loglen);
+	if (NULL == r->log || r->loglen < sizeof(struct header)) {
+		fprintf(stderr, "%s: not a record\n", path);
+		record_reader_close(r);
+		free(idxpath);
+		return NULL;
+	}
+	r->header = (struct header*)r->log;
+	if (RECORD_MAGIC != r->header->magic
+	||  RECORD_VERSION != r->header->version) {
+		fprintf(stderr, "%s: not a record\n", path);
+		record_reader_close(r);
+		free(idxpath);
+		return NULL;
+	}
+
+	/* without an index seeking scans from the start */
+	r->idx = map_read(idxpath, &r->idxsize);
+	r->idxlen = r->idxsize/sizeof(struct index);
+	free(idxpath);
+
+	/* a writer that was killed leaves its preallocated tail zeroed */
+	for (n = 0; n < r->idxlen; n++)
+		if (r->idx[n].offset < sizeof(struct header)
+		||  r->loglen <= r->idx[n].offset)
+			break;
+	r->idxlen = n;
+
+	r->offset = sizeof(struct header);
+	return r;
+}
+
+
+int record_reader_close(record_reader *r)
+{
+	if (NULL == r)
+		return 0;
+	if (NULL != r->log)
+		munmap(r->log, r->loglen);
+	if (NULL != r->idx)
+		munmap(r->idx, r->idxsize);
+	free(r);
+	return 0;
+}
+
+
+uint32_t record_reader_tag(record_reader *r)
+{
+	return r->header->tag;
+}
+
+
+uint32_t record_reader_id(record_reader *r)
+{
+	return r->header->id;
+}
+
+
+int64_t record_reader_start(record_reader *r)
+{
+	return r->header->start_ms;
+}
+
+
+/* returns 0 on an entry, 1 at the end of the log and -1 if corrupted */
+int record_reader_next(record_reader *r, struct record_entry *e)
+{
+	uint64_t delta;
+	uint64_t len;
+	uint64_t lit;
+	uint64_t zeros;
+	size_t   off = r->offset;
+	size_t   n = 0;
+	int      direction;
+
+	assert(NULL != r && "r cannot be NULL");
+	assert(NULL != e && "e cannot be NULL");
+
+	if (r->loglen <= off)
+		return 1;
+	if (-1 == varint_get(r->log, r->loglen, &off, &delta))
+		return 1;
+	if (r->loglen <= off || !r->log[off])
+		return 1;
+	direction = r->log[off++];
+	if (-1 == varint_get(r->log, r->loglen, &off, &len)
+	||  RECORD_MAX < len)
+		return -1;
+
+	while (n < len) {
+		if (-1 == varint_get(r->log, r->loglen, &off, &lit)
+		||  len - n < lit || r->loglen - off < lit)
+			return -1;
+		memcpy(r->buf + n, r->log + off, lit);
+		off += lit;
+		n   += lit;
+
+		if (-1 == varint_get(r->log, r->loglen, &off, &zeros)
+		||  len - n < zeros)
+			return -1;
+		memset(r->buf + n, 0, zeros);
+		n += zeros;
+	}
+
+	r->offset   = off;
+	r->time_ms += delta;
+	e->time_ms   = r->time_ms;
+	e->direction = direction;
+	e->len       = len;
+	e->buf       = r->buf;
+	return 0;
+}
+
+
+/*
+ * Leaves the reader at the first entry at or after time_ms, returns -1
+ * when there is none.
+ */
+int record_reader_seek(record_reader *r, uint64_t time_ms)
+{
+	struct record_entry e;
+	size_t lo = 0;
+	size_t hi = r->idxlen;
+	size_t mid;
+	size_t off;
+	uint64_t t;
+
+	assert(NULL != r && "r cannot be NULL");
+
+	r->offset  = sizeof(struct header);
+	r->time_ms = 0;
+	while (lo < hi) {
+		mid = lo + (hi - lo)/2;
+		if (r->idx[mid].time_ms <= time_ms)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo) {
+		/* the entry's delta is relative to the one before it */
+		off = r->idx[lo - 1].offset;
+		if (-1 == varint_get(r->log, r->loglen, &off, &t))
+			return -1;
+		r->offset  = r->idx[lo - 1].offset;
+		r->time_ms = r->idx[lo - 1].time_ms - t;
+	}
+
+	while (1) {
+		off = r->offset;
+		t   = r->time_ms;
+		if (0 != record_reader_next(r, &e))
+			return -1;
+		if (time_ms <= e.time_ms)
+			break;
+	}
+	r->offset  = off;
+	r->time_ms = t;
+	return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * append-only, memory-mapped datagram log
+ */
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define RECORD_MAX      (65536)
+#define RECORD_INDEX_MS (1000)
+
+
+enum record_direction {
+	RECORD_RECV = 1,
+	RECORD_SEND = 2
+};
+
+
+struct record_entry {
+	uint64_t    time_ms;    /* monotonic, since record_open */
+	int         direction;
+	size_t      len;
+	const void *buf;        /* valid until the next read */
+};
+
+
+typedef struct record        record;
+typedef struct record_reader record_reader;
+
+record* record_open(  const char *path, uint32_t tag, uint32_t id);
+int     record_close( record *r);
+int     record_append(record *r, int direction, const void *buf, size_t len);
+
+record_reader* record_reader_open( const char *path);
+int            record_reader_close(record_reader *r);
+uint32_t       record_reader_tag(  record_reader *r);
+uint32_t       record_reader_id(   record_reader *r);
+int64_t        record_reader_start(record_reader *r);
+int            record_reader_next( record_reader *r, struct record_entry *e);
+int            record_reader_seek( record_reader *r, uint64_t time_ms);
+
+
+#endif /* !RECORD_H */
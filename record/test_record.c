@@ -0,0 +1,137 @@
+#define _XOPEN_SOURCE 500
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "record.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+	#define sleep_ms(s) Sleep(s)
+#else
+	#include <unistd.h>
+	#define sleep_ms(s) usleep(1000*(s))
+#endif
+
+
+#define ENTRIES (600)
+
+
+static size_t fill(unsigned char *buf, int i)
+{
+	size_t len = 1 + i*37%1500;
+	size_t k;
+
+	memset(buf, 0, len);
+	for (k = 0; k < len; k += 1 + (i + k)%13)
+		buf[k] = (unsigned char)(i + k);
+	return len;
+}
+
+
+int main(int argc, char **argv)
+{
+	char tmp[] = "/tmp/test_record.XXXXXX";
+	char idx[sizeof(tmp) + sizeof(".idx")];
+	const char *path = tmp;
+	static unsigned char buf[RECORD_MAX];
+	struct record_entry e;
+	uint64_t times[ENTRIES];
+	record_reader *rr;
+	record *r;
+	size_t len;
+	size_t raw = 0;
+	int fails = 0;
+	int i;
+	int s;
+
+
+	/* a file of our own, removed with its index at the end */
+	if (1 < argc) {
+		path = argv[1];
+	} else {
+		s = mkstemp(tmp);
+		if (-1 == s) {
+			perror(tmp);
+			return EXIT_FAILURE;
+		}
+		close(s);
+	}
+
+	r = record_open(path, 0xcafe, 0xdeadbeef);
+	if (NULL == r)
+		return EXIT_FAILURE;
+	for (i = 0; i < ENTRIES; i++) {
+		len = fill(buf, i);
+		raw += len;
+		if (-1 == record_append(r, i%2 ? RECORD_SEND:RECORD_RECV, buf, len)) {
+			perror("record_append");
+			return EXIT_FAILURE;
+		}
+		if (0 == i%100)
+			sleep_ms(600);
+	}
+	record_close(r);
+
+
+	rr = record_reader_open(path);
+	if (NULL == rr)
+		return EXIT_FAILURE;
+	if (0xcafe != record_reader_tag(rr)) {
+		printf("tag 0x%x\n", record_reader_tag(rr));
+		fails++;
+	}
+	if (0xdeadbeef != record_reader_id(rr)) {
+		printf("id 0x%x\n", record_reader_id(rr));
+		fails++;
+	}
+	for (i = 0; 0 == (s = record_reader_next(rr, &e)); i++) {
+		len = fill(buf, i);
+		times[i] = e.time_ms;
+		if (len != e.len || memcmp(buf, e.buf, len)
+		||  (i%2 ? RECORD_SEND:RECORD_RECV) != e.direction) {
+			printf("entry %d differs\n", i);
+			fails++;
+		}
+	}
+	if (ENTRIES != i || 1 != s) {
+		printf("read %d entries (%d), wrote %d\n", i, s, ENTRIES);
+		fails++;
+	}
+	printf("%zu bytes of datagrams, last at %llu ms\n",
+		raw, (unsigned long long)times[ENTRIES - 1]);
+
+
+	for (i = 0; i < ENTRIES; i += 50) {
+		if (-1 == record_reader_seek(rr, times[i])
+		||  0 != record_reader_next(rr, &e)
+		||  e.time_ms != times[i]) {
+			printf("seek to %llu ms failed\n",
+				(unsigned long long)times[i]);
+			fails++;
+			continue;
+		}
+		if (0 < i && times[i - 1] == times[i])
+			continue;
+		if (fill(buf, i) != e.len || memcmp(buf, e.buf, e.len)) {
+			printf("seek to %llu ms landed elsewhere\n",
+				(unsigned long long)times[i]);
+			fails++;
+		}
+	}
+	if (-1 != record_reader_seek(rr, times[ENTRIES - 1] + 1)) {
+		printf("seek past the end succeeded\n");
+		fails++;
+	}
+	record_reader_close(rr);
+	if (path == tmp) {
+		sprintf(idx, "%s.idx", tmp);
+		unlink(tmp);
+		unlink(idx);
+	}
+
+
+	printf("%s\n", fails ? "FAIL":"OK");
+	return fails ? EXIT_FAILURE:EXIT_SUCCESS;
+}
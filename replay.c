@@ -0,0 +1,195 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "videojuego.h"
+
+
+#define TIPOS (16)
+
+
+/*
+ * Feeds a --record log back through mensaje_recibir, with time_now_ms
+ * pinned to the time each datagram was recorded at, so the game state
+ * evolves the same whatever the replay speed. Nothing is sent: what the
+ * game queues is counted and dropped.
+ */
+
+
+static void esperar_ms(int64_t ms)
+{
+	struct timespec espera;
+
+	if (ms <= 0)
+		return;
+	espera.tv_sec  = ms/1000;
+	espera.tv_nsec = ms%1000*1000000L;
+	nanosleep(&espera, NULL);
+}
+
+
+static int64_t reloj_ms(void)
+{
+	struct timespec spec;
+
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return (int64_t)spec.tv_sec*1000 + spec.tv_nsec/1000000;
+}
+
+
+static void print_usage(const char *progname)
+{
+	fprintf(stderr, "USAGE: %s [OPTIONS]... FILE\n", progname);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "OPTIONS\n");
+
+	fprintf(stderr, "\t--speed X\n");
+	fprintf(stderr, "\t\tReplay X times faster, 0 for no waits "
+		"(default 1)\n\n");
+
+	fprintf(stderr, "\t--from MS\n");
+	fprintf(stderr, "\t\tStart MS milliseconds into the log\n\n");
+
+	fprintf(stderr, "\t--to MS\n");
+	fprintf(stderr, "\t\tStop MS milliseconds into the log\n\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	struct videojuego *vj = NULL;
+	struct queue_message qm;
+	struct record_entry  e;
+	record_reader *rr;
+	const char *ruta = NULL;
+	double   velocidad = 1.0;
+	uint64_t desde = 0;
+	uint64_t hasta = (uint64_t)-1;
+	uint64_t primero = 0;
+	uint64_t ultimo = 0;
+	uint64_t recibidos[TIPOS] = {0};
+	uint64_t enviados[TIPOS]  = {0};
+	uint64_t generados[TIPOS] = {0};
+	uint32_t tick = 0;
+	int64_t  inicio;
+	int64_t  comienzo;
+	char    *args[] = {argv[0], "--port", "0", NULL};
+	size_t   i;
+	int n = 0;
+	int s;
+
+
+	for (i = 1; i < (size_t)argc; i++) {
+		if (NULL != argv[i + 1] && 0 == strcmp("--speed", argv[i]))
+			velocidad = strtod(argv[++i], NULL);
+		else if (NULL != argv[i + 1] && 0 == strcmp("--from", argv[i]))
+			desde = strtoull(argv[++i], NULL, 0);
+		else if (NULL != argv[i + 1] && 0 == strcmp("--to", argv[i]))
+			hasta = strtoull(argv[++i], NULL, 0);
+		else if ('-' != argv[i][0])
+			ruta = argv[i];
+		else {
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (NULL == ruta || velocidad < 0) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	rr = record_reader_open(ruta);
+	if (NULL == rr)
+		return EXIT_FAILURE;
+	if (-1 == record_reader_seek(rr, desde)) {
+		fprintf(stderr, "%s: nothing after %llu ms\n",
+			ruta, (unsigned long long)desde);
+		return EXIT_FAILURE;
+	}
+
+
+	/* the replay owns no port, an ephemeral one keeps it off the game */
+	inicio = record_reader_start(rr);
+	time_set_ms(inicio);
+	vj = videojuego_crear(3, args, record_reader_tag(rr));
+
+	/* PONGs and ACKs are addressed to the host that recorded them */
+	if (0 != record_reader_id(rr))
+		vj->id = record_reader_id(rr);
+
+	comienzo = reloj_ms();
+	while (0 == (s = record_reader_next(rr, &e))) {
+		if (hasta < e.time_ms)
+			break;
+		if (sizeof(qm) != e.len)
+			continue;
+		if (!n++)
+			primero = e.time_ms;
+		ultimo = e.time_ms;
+		if (0 < velocidad)
+			esperar_ms((e.time_ms - primero)/velocidad
+				- (reloj_ms() - comienzo));
+
+		memcpy(&qm, e.buf, sizeof(qm));
+		time_set_ms(inicio + e.time_ms);
+		if (RECORD_SEND == e.direction) {
+			enviados[qm.mensaje.tipo%TIPOS]++;
+			/* the server applies inputs right before each snapshot */
+			if (MODO_SERVIDOR == vj->modo
+			&&  MENSAJE_ESTADO == qm.mensaje.tipo
+			&&  tick != qm.mensaje.datos.estado.tick) {
+				tick = qm.mensaje.datos.estado.tick;
+				pthread_mutex_lock(&vj->lock);
+				for (i = 0; i < vj->jugadores_len; i++)
+					jugador_entrada_aplicar(vj,
+						&vj->jugadores[i],
+						time_now_ms());
+				pthread_mutex_unlock(&vj->lock);
+			}
+			continue;
+		}
+
+		recibidos[qm.mensaje.tipo%TIPOS]++;
+		fiable_revisar(vj);
+		reloj_revisar(vj);
+		envio_revisar(vj);
+		conexion_revisar(vj);
+		mensaje_recibir(vj, &qm);
+		mensajes_aplicar(vj);
+
+		while (queue_size(vj->queue_send)) {
+			queue_dequeue(vj->queue_send, &qm);
+			generados[qm.mensaje.tipo%TIPOS]++;
+		}
+	}
+	if (-1 == s)
+		fprintf(stderr, "%s: corrupted after %d datagrams\n", ruta, n);
+
+
+	printf("%d datagrams, %llu ms of play in %lld ms\n", n,
+		(unsigned long long)(ultimo - primero),
+		(long long)(reloj_ms() - comienzo));
+	printf("%-6s %10s %10s %10s\n", "TYPE", "RECV", "SENT", "REPLAYED");
+	for (i = 0; i < TIPOS; i++)
+		if (recibidos[i] || enviados[i] || generados[i])
+			printf("%-6zu %10llu %10llu %10llu\n", i,
+				(unsigned long long)recibidos[i],
+				(unsigned long long)enviados[i],
+				(unsigned long long)generados[i]);
+
+	printf("%-10s %6s %6s %10s %10s\n", "PLAYER", "X", "Y", "POINTS",
+		"CRASHES");
+	for (i = 0; i < vj->jugadores_len; i++)
+		printf("0x%08x %6d %6d %10llu %10llu\n",
+			vj->jugadores[i].id,
+			vj->pelotas->x[i],
+			vj->pelotas->y[i],
+			(unsigned long long)vj->jugadores[i].puntos,
+			(unsigned long long)vj->jugadores[i].choques);
+
+	record_reader_close(rr);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "videojuego.h"
+
+
+/*
+ * Headless authoritative server: applies the inputs clients sent since
+ * the last tick, runs crashes and scoring for everybody and sends each
+ * client a MENSAJE_ESTADO with its own ball and the ones near it, every
+ * vj->paso_ms.
+ */
+static void* servidor_thread(void *param)
+{
+	struct videojuego *vj = param;
+	struct timespec espera;
+	int32_t siguiente = time_now_ms();
+	int32_t ahora;
+	size_t  i;
+
+	while (1) {
+		mensajes_aplicar(vj);
+		ahora = time_now_ms();
+
+		pthread_mutex_lock(&vj->lock);
+		for (i = 0; i < vj->jugadores_len; i++)
+			jugador_entrada_aplicar(vj, &vj->jugadores[i], ahora);
+		pthread_mutex_unlock(&vj->lock);
+
+		estado_enviar(vj);
+
+		siguiente += vj->paso_ms;
+		ahora = time_now_ms();
+		if (siguiente - ahora <= 0) {
+			siguiente = ahora;
+			continue;
+		}
+		espera.tv_sec  = (siguiente - ahora)/1000;
+		espera.tv_nsec = (siguiente - ahora)%1000*1000000L;
+		nanosleep(&espera, NULL);
+	}
+
+	return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+	struct videojuego *vj = NULL;
+	pthread_t thread_recv;
+	pthread_t thread_send;
+	pthread_t thread_tick;
+
+
+	vj = videojuego_crear(argc, argv, MODO_SERVIDOR);
+
+
+	pthread_create(&thread_recv, NULL, recv_thread, vj);
+	pthread_create(&thread_send, NULL, send_thread, vj);
+	pthread_create(&thread_tick, NULL, servidor_thread, vj);
+	pthread_join(thread_recv, NULL);
+	pthread_join(thread_send, NULL);
+	pthread_join(thread_tick, NULL);
+
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "spatial.h"
+
+
+/*
+ * Players touching each other, found by checking every pair and by
+ * rebuilding the hash and asking it, as every tick would. The world
+ * grows with the players so each one has the same room.
+ */
+
+
+#define ROOM    (50)
+#define RADIUS  (12)
+#define ROUNDS  (20)
+
+
+static double now_ns(void)
+{
+	struct timespec spec;
+
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return spec.tv_sec*1e9 + spec.tv_nsec;
+}
+
+
+static void count(size_t i, size_t j, void *arg)
+{
+	(void)i;
+	(void)j;
+	(*(size_t*)arg)++;
+}
+
+
+int main()
+{
+	static const size_t players[] = {100, 500, 2000, 10000};
+	int32_t *x;
+	int32_t *y;
+	spatial *s;
+	size_t   n;
+	size_t   i;
+	size_t   j;
+	size_t   p;
+	size_t   naive_pairs;
+	size_t   hash_pairs;
+	double   t;
+	double   naive_ns;
+	double   hash_ns;
+	int32_t  side;
+	int      k;
+
+
+	printf("%-8s %8s %14s %14s\n", "PLAYERS", "PAIRS", "naive us/TICK",
+		"spatial us/TICK");
+	for (p = 0; p < sizeof(players)/sizeof(players[0]); p++) {
+		n = players[p];
+		for (side = ROOM; (size_t)side*side < n*ROOM*ROOM; side++)
+			;
+		x = malloc(n*sizeof(*x));
+		y = malloc(n*sizeof(*y));
+		s = spatial_create(2*RADIUS, n);
+		if (NULL == x || NULL == y || NULL == s) {
+			perror("alloc");
+			return EXIT_FAILURE;
+		}
+		srand(1);
+		for (i = 0; i < n; i++) {
+			x[i] = rand()%side;
+			y[i] = rand()%side;
+		}
+
+		naive_pairs = 0;
+		t = now_ns();
+		for (k = 0; k < ROUNDS; k++)
+			for (i = 0; i < n; i++)
+			for (j = i + 1; j < n; j++) {
+				int64_t dx = x[j] - x[i];
+				int64_t dy = y[j] - y[i];
+
+				naive_pairs += dx*dx + dy*dy <= RADIUS*RADIUS;
+			}
+		naive_ns = (now_ns() - t)/ROUNDS;
+
+		hash_pairs = 0;
+		t = now_ns();
+		for (k = 0; k < ROUNDS; k++) {
+			spatial_build(s, x, y, n);
+			spatial_pairs(s, RADIUS, count, &hash_pairs);
+		}
+		hash_ns = (now_ns() - t)/ROUNDS;
+
+		printf("%-8zu %8zu %14.1f %14.1f%s\n", n, hash_pairs/ROUNDS,
+			naive_ns/1e3, hash_ns/1e3,
+			naive_pairs == hash_pairs ? "":" MISMATCH");
+
+		spatial_free(s);
+		free(x);
+		free(y);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "spatial.h"
+
+
+/*
+ * Points are counting-sorted by the hash of their grid cell into a power
+ * of two number of buckets, at least as many as points, so a rebuild is
+ * two passes with no allocation once the capacity is there. Cells that
+ * share a bucket are told apart by the cell kept with every point.
+ * A query looks at the cells its radius box covers, and a pair search
+ * looks from every point at its own cell and the cells after it, so
+ * each pair comes up once. Cells about as big as the radius keep that
+ * to a handful of cells per point.
+ */
+
+
+#define SPATIAL_MIN (16)
+
+
+struct spatial {
+	int32_t   cell;
+	size_t    len;
+	size_t    cap;
+	int       shift;
+	uint32_t *start;   /* bucket b holds sorted points start[b] to start[b+1] */
+	uint32_t *bucket;  /* of input point i, while building */
+	size_t   *index;   /* sorted point k is input point index[k] */
+	int32_t  *x;
+	int32_t  *y;
+	int32_t  *cx;
+	int32_t  *cy;
+};
+
+
+static int32_t spatial_cell(spatial *s, int64_t v)
+{
+	return (int32_t)(v < 0 ? -((s->cell - 1 - v)/s->cell):v/s->cell);
+}
+
+
+static uint32_t spatial_hash(spatial *s, int32_t cx, int32_t cy)
+{
+	uint32_t h = (uint32_t)cx*73856093u ^ (uint32_t)cy*19349663u;
+
+	return (uint32_t)(h*2654435769u) >> s->shift;
+}
+
+
+static int spatial_alloc(spatial *s, size_t capacity)
+{
+	void  **arrays[] = {
+		(void**)&s->bucket, (void**)&s->x, (void**)&s->y,
+		(void**)&s->cx, (void**)&s->cy
+	};
+	size_t  n = SPATIAL_MIN;
+	int     shift = 32 - 4;
+	void   *p;
+	size_t  i;
+
+	while (n < capacity) {
+		n <<= 1;
+		shift--;
+	}
+	for (i = 0; i < sizeof(arrays)/sizeof(arrays[0]); i++) {
+		p = realloc(*arrays[i], n*sizeof(int32_t));
+		if (NULL == p)
+			return -1;
+		*arrays[i] = p;
+	}
+	p = realloc(s->index, n*sizeof(*s->index));
+	if (NULL == p)
+		return -1;
+	s->index = p;
+	p = realloc(s->start, (n + 1)*sizeof(*s->start));
+	if (NULL == p)
+		return -1;
+	s->start = p;
+
+	s->cap   = n;
+	s->shift = shift;
+	return 0;
+}
+
+
+spatial* spatial_create(int32_t cell, size_t capacity)
+{
+	spatial *s;
+
+	if (cell < 1)
+		return NULL;
+	s = calloc(1, sizeof(*s));
+	if (NULL == s)
+		return NULL;
+	s->cell = cell;
+	if (-1 == spatial_alloc(s, capacity)) {
+		spatial_free(s);
+		return NULL;
+	}
+	memset(s->start, 0, (s->cap + 1)*sizeof(*s->start));
+	return s;
+}
+
+
+int spatial_free(spatial *s)
+{
+	if (NULL == s)
+		return -1;
+	free(s->start);
+	free(s->bucket);
+	free(s->index);
+	free(s->x);
+	free(s->y);
+	free(s->cx);
+	free(s->cy);
+	free(s);
+	return 0;
+}
+
+
+int spatial_build(spatial *s, const int32_t *x, const int32_t *y,
+		size_t len)
+{
+	uint32_t b;
+	size_t   k;
+	size_t   i;
+
+	if (UINT32_MAX <= len)
+		return -1;
+	if (s->cap < len && -1 == spatial_alloc(s, len))
+		return -1;
+
+	memset(s->start, 0, (s->cap + 1)*sizeof(*s->start));
+	for (i = 0; i < len; i++) {
+		b = spatial_hash(s, spatial_cell(s, x[i]), spatial_cell(s, y[i]));
+		s->bucket[i] = b;
+		s->start[b + 1]++;
+	}
+	for (b = 0; b < s->cap; b++)
+		s->start[b + 1] += s->start[b];
+
+	/* start[b] ends up where bucket b + 1 begins, moved back below */
+	for (i = 0; i < len; i++) {
+		k = s->start[s->bucket[i]]++;
+		s->index[k] = i;
+		s->x[k]  = x[i];
+		s->y[k]  = y[i];
+		s->cx[k] = spatial_cell(s, x[i]);
+		s->cy[k] = spatial_cell(s, y[i]);
+	}
+	memmove(s->start + 1, s->start, s->cap*sizeof(*s->start));
+	s->start[0] = 0;
+	s->len = len;
+	return 0;
+}
+
+
+static int spatial_near(int64_t dx, int64_t dy, int64_t radius)
+{
+	if (dx < -radius || radius < dx || dy < -radius || radius < dy)
+		return 0;
+	return dx*dx + dy*dy <= radius*radius;
+}
+
+
+size_t spatial_query(spatial *s, int32_t x, int32_t y, int32_t radius,
+		spatial_visit fn, void *arg)
+{
+	int32_t  cx0 = spatial_cell(s, (int64_t)x - radius);
+	int32_t  cx1 = spatial_cell(s, (int64_t)x + radius);
+	int32_t  cy0 = spatial_cell(s, (int64_t)y - radius);
+	int32_t  cy1 = spatial_cell(s, (int64_t)y + radius);
+	uint32_t b;
+	size_t   n = 0;
+	size_t   k;
+	int64_t  cx;
+	int64_t  cy;
+
+	if (radius < 0)
+		return 0;
+
+	/* past as many cells as points every point is cheaper */
+	if ((uint64_t)s->len
+	<   (uint64_t)((int64_t)cx1 - cx0 + 1)*((int64_t)cy1 - cy0 + 1)) {
+		for (k = 0; k < s->len; k++)
+			if (spatial_near((int64_t)s->x[k] - x,
+					(int64_t)s->y[k] - y, radius)) {
+				fn(s->index[k], arg);
+				n++;
+			}
+		return n;
+	}
+
+	for (cy = cy0; cy <= cy1; cy++)
+	for (cx = cx0; cx <= cx1; cx++) {
+		b = spatial_hash(s, cx, cy);
+		for (k = s->start[b]; k < s->start[b + 1]; k++) {
+			if (s->cx[k] != cx || s->cy[k] != cy)
+				continue;
+			if (!spatial_near((int64_t)s->x[k] - x,
+					(int64_t)s->y[k] - y, radius))
+				continue;
+			fn(s->index[k], arg);
+			n++;
+		}
+	}
+	return n;
+}
+
+
+size_t spatial_pairs(spatial *s, int32_t radius, spatial_pair fn, void *arg)
+{
+	int32_t  reach = (int32_t)(((int64_t)radius + s->cell - 1)/s->cell);
+	uint32_t b;
+	size_t   n = 0;
+	size_t   p;
+	size_t   q;
+	int64_t  cx;
+	int64_t  cy;
+	int32_t  dx;
+	int32_t  dy;
+
+	if (radius < 0)
+		return 0;
+
+	for (p = 0; p < s->len; p++)
+	for (dy = 0; dy <= reach; dy++)
+	for (dx = dy ? -reach:0; dx <= reach; dx++) {
+		cx = (int64_t)s->cx[p] + dx;
+		cy = (int64_t)s->cy[p] + dy;
+		b = spatial_hash(s, cx, cy);
+		for (q = s->start[b]; q < s->start[b + 1]; q++) {
+			if (s->cx[q] != cx || s->cy[q] != cy)
+				continue;
+			if (0 == dx && 0 == dy && q <= p)
+				continue;
+			if (!spatial_near((int64_t)s->x[q] - s->x[p],
+					(int64_t)s->y[q] - s->y[p], radius))
+				continue;
+			fn(s->index[p], s->index[q], arg);
+			n++;
+		}
+	}
+	return n;
+}
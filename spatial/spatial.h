@@ -0,0 +1,31 @@
+/*
+ * uniform grid spatial hash over 2D points, not thread-safe
+ */
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Rebuilt from scratch with spatial_build, point i being (x[i], y[i]).
+ * Queries report points by that index, and a distance d matches when
+ * it is at most radius.
+ */
+typedef struct spatial spatial;
+
+typedef void (*spatial_visit)(size_t i, void *arg);
+typedef void (*spatial_pair)( size_t i, size_t j, void *arg);
+
+spatial* spatial_create(int32_t cell, size_t capacity);
+int      spatial_free(  spatial *s);
+int      spatial_build( spatial *s, const int32_t *x, const int32_t *y,
+		size_t len);
+size_t   spatial_query( spatial *s, int32_t x, int32_t y, int32_t radius,
+		spatial_visit fn, void *arg);
+size_t   spatial_pairs( spatial *s, int32_t radius,
+		spatial_pair fn, void *arg);
+
+
+#endif /* !SPATIAL_H */
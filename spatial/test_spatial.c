@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "spatial.h"
+
+
+#define POINTS (3001)
+
+
+static int32_t x[POINTS];
+static int32_t y[POINTS];
+static int     seen[POINTS];
+
+
+static void visit(size_t i, void *arg)
+{
+	(void)arg;
+	seen[i]++;
+}
+
+
+static void pair(size_t i, size_t j, void *arg)
+{
+	size_t *bad = arg;
+
+	if (i == j)
+		(*bad)++;
+	seen[i]++;
+	seen[j]++;
+}
+
+
+static int near(size_t i, int32_t px, int32_t py, int32_t radius)
+{
+	long long dx = (long long)x[i] - px;
+	long long dy = (long long)y[i] - py;
+
+	return dx*dx + dy*dy <= (long long)radius*radius;
+}
+
+
+int main()
+{
+	static const int32_t cells[]  = {1, 7, 32, 100, 5000};
+	static const int32_t radii[]  = {0, 5, 32, 77, 400, 100000};
+	static int expected[POINTS];
+	spatial *s;
+	size_t   len;
+	size_t   bad = 0;
+	size_t   n;
+	size_t   m;
+	size_t   i;
+	size_t   j;
+	int fails = 0;
+	int c;
+	int r;
+	int q;
+
+
+	srand(1);
+	for (c = 0; c < (int)(sizeof(cells)/sizeof(cells[0])) && !fails; c++) {
+		s = spatial_create(cells[c], 0);
+		if (NULL == s) {
+			perror("spatial_create");
+			return EXIT_FAILURE;
+		}
+
+		/* growing rebuilds, clustered and spread, either sign */
+		for (len = 1; len <= POINTS && !fails; len = 3*len + 5) {
+			for (i = 0; i < len; i++) {
+				x[i] = i%3 ? rand()%2001 - 1000:rand()%41 - 20;
+				y[i] = i%3 ? rand()%2001 - 1000:rand()%41 - 20;
+			}
+			if (-1 == spatial_build(s, x, y, len)) {
+				perror("spatial_build");
+				return EXIT_FAILURE;
+			}
+
+			for (r = 0; r < (int)(sizeof(radii)/sizeof(radii[0])); r++)
+			for (q = 0; q < 20 && !fails; q++) {
+				int32_t px = rand()%2401 - 1200;
+				int32_t py = rand()%2401 - 1200;
+
+				memset(seen, 0, sizeof(seen));
+				n = spatial_query(s, px, py, radii[r], visit, NULL);
+				for (m = 0, i = 0; i < len; i++) {
+					m += near(i, px, py, radii[r]);
+					if (seen[i] != near(i, px, py, radii[r])) {
+						printf("cell %d radius %d: point %zu "
+							"seen %d times\n", cells[c],
+							radii[r], i, seen[i]);
+						fails++;
+						break;
+					}
+				}
+				if (n != m) {
+					printf("query counted %zu of %zu\n", n, m);
+					fails++;
+				}
+			}
+
+			/* every point takes part in as many pairs as it has neighbours */
+			for (r = 0; r < 4 && !fails; r++) {
+				memset(seen, 0, sizeof(seen));
+				memset(expected, 0, sizeof(expected));
+				for (m = 0, i = 0; i < len; i++)
+				for (j = i + 1; j < len; j++)
+					if (near(j, x[i], y[i], radii[r])) {
+						expected[i]++;
+						expected[j]++;
+						m++;
+					}
+				n = spatial_pairs(s, radii[r], pair, &bad);
+				if (n != m || bad
+				||  memcmp(seen, expected, len*sizeof(*seen))) {
+					printf("cell %d radius %d: %zu pairs of %zu\n",
+						cells[c], radii[r], n, m);
+					fails++;
+				}
+			}
+		}
+		spatial_free(s);
+	}
+
+	if (NULL != spatial_create(0, 0)) {
+		printf("a zero cell was accepted\n");
+		fails++;
+	}
+
+
+	printf("%s\n", fails ? "FAIL":"OK");
+	return fails ? EXIT_FAILURE:EXIT_SUCCESS;
+}
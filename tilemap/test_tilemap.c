@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "tilemap.h"
+
+
+#define WIDTH  (203)
+#define HEIGHT (131)
+
+
+static unsigned char ref[HEIGHT][WIDTH];
+
+
+static int ref_get(int32_t x, int32_t y)
+{
+	if (x < 0 || WIDTH <= x || y < 0 || HEIGHT <= y)
+		return 0;
+	return ref[y][x];
+}
+
+
+int main()
+{
+	tilemap *m;
+	uint64_t bits;
+	uint64_t want;
+	int32_t  x;
+	int32_t  y;
+	int fails = 0;
+	int n;
+	int k;
+	int q;
+
+
+	m = tilemap_create(WIDTH, HEIGHT);
+	if (NULL == m) {
+		perror("tilemap_create");
+		return EXIT_FAILURE;
+	}
+	if (WIDTH != tilemap_width(m) || HEIGHT != tilemap_height(m)) {
+		printf("wrong size\n");
+		fails++;
+	}
+
+	/* clearing never allocates */
+	for (y = 0; y < HEIGHT; y++)
+	for (x = 0; x < WIDTH; x++)
+		tilemap_set(m, x, y, 0);
+	if (0 != tilemap_chunks(m)) {
+		printf("%zu chunks for an empty map\n", tilemap_chunks(m));
+		fails++;
+	}
+
+	/* walls only in the left half of the chunks */
+	srand(1);
+	for (q = 0; q < 20000; q++) {
+		x = rand()%WIDTH;
+		y = rand()%(HEIGHT/2);
+		k = rand()%3 != 0;
+		if (-1 == tilemap_set(m, x, y, k)) {
+			perror("tilemap_set");
+			return EXIT_FAILURE;
+		}
+		ref[y][x] = k;
+	}
+	if ((size_t)((WIDTH + 63)/64*((HEIGHT/2 + 63)/64)) != tilemap_chunks(m)) {
+		printf("%zu chunks\n", tilemap_chunks(m));
+		fails++;
+	}
+
+	for (y = -70; y < HEIGHT + 70 && !fails; y++)
+	for (x = -70; x < WIDTH + 70; x++)
+		if (tilemap_get(m, x, y) != ref_get(x, y)) {
+			printf("tile (%d, %d) is %d\n", x, y, tilemap_get(m, x, y));
+			fails++;
+			break;
+		}
+
+	for (q = 0; q < 200000 && !fails; q++) {
+		x = rand()%(WIDTH + 200) - 100;
+		y = rand()%(HEIGHT + 20) - 10;
+		n = 1 + rand()%64;
+		bits = tilemap_row(m, x, y, n);
+		for (want = 0, k = 0; k < n; k++)
+			want |= (uint64_t)ref_get(x + k, y) << k;
+		if (bits != want) {
+			printf("row (%d, %d) x %d: %016llx != %016llx\n", x, y, n,
+				(unsigned long long)bits, (unsigned long long)want);
+			fails++;
+		}
+	}
+
+	if (-1 != tilemap_set(m, WIDTH, 0, 1) || -1 != tilemap_set(m, 0, -1, 1)) {
+		printf("set outside the map\n");
+		fails++;
+	}
+	tilemap_free(m);
+
+	if (NULL != tilemap_create(0, 5)) {
+		printf("an empty map was created\n");
+		fails++;
+	}
+
+
+	printf("%s\n", fails ? "FAIL":"OK");
+	return fails ? EXIT_FAILURE:EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+#include <stdlib.h>
+
+
+#include "tilemap.h"
+
+
+/*
+ * A chunk is TILEMAP_CHUNK rows of one 64-bit word each, bit k of a row
+ * being the tile k to the right of the chunk's left edge. Chunks are
+ * kept row-major in a table of pointers, NULL for the ones with no
+ * walls, so a mostly open map costs little more than that table.
+ */
+
+
+#define TILEMAP_MASK (TILEMAP_CHUNK - 1)
+
+
+struct tilemap {
+	uint64_t **chunks;
+	int32_t    width;
+	int32_t    height;
+	int32_t    xchunks;
+	int32_t    ychunks;
+	size_t     used;
+};
+
+
+/* floor division, tiles left of or above the map give negative chunks */
+static int32_t tilemap_chunk(int32_t v)
+{
+	return (int32_t)((int64_t)v >> TILEMAP_CHUNK_BITS);
+}
+
+
+static uint64_t* tilemap_find(tilemap *m, int32_t cx, int32_t cy)
+{
+	if (cx < 0 || m->xchunks <= cx || cy < 0 || m->ychunks <= cy)
+		return NULL;
+	return m->chunks[(size_t)cy*m->xchunks + cx];
+}
+
+
+tilemap* tilemap_create(int32_t width, int32_t height)
+{
+	tilemap *m;
+
+	if (width < 1 || height < 1)
+		return NULL;
+	m = calloc(1, sizeof(*m));
+	if (NULL == m)
+		return NULL;
+	m->width   = width;
+	m->height  = height;
+	m->xchunks = tilemap_chunk(width - 1) + 1;
+	m->ychunks = tilemap_chunk(height - 1) + 1;
+	m->chunks  = calloc((size_t)m->xchunks*m->ychunks, sizeof(*m->chunks));
+	if (NULL == m->chunks) {
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+
+int tilemap_free(tilemap *m)
+{
+	size_t i;
+
+	if (NULL == m)
+		return -1;
+	for (i = 0; i < (size_t)m->xchunks*m->ychunks; i++)
+		free(m->chunks[i]);
+	free(m->chunks);
+	free(m);
+	return 0;
+}
+
+
+int32_t tilemap_width(tilemap *m)
+{
+	return m->width;
+}
+
+
+int32_t tilemap_height(tilemap *m)
+{
+	return m->height;
+}
+
+
+/* chunks holding walls, each TILEMAP_CHUNK*8 bytes */
+size_t tilemap_chunks(tilemap *m)
+{
+	return m->used;
+}
+
+
+int tilemap_get(tilemap *m, int32_t x, int32_t y)
+{
+	uint64_t *c = tilemap_find(m, tilemap_chunk(x), tilemap_chunk(y));
+
+	if (NULL == c)
+		return 0;
+	return c[y & TILEMAP_MASK] >> (x & TILEMAP_MASK) & 1;
+}
+
+
+int tilemap_set(tilemap *m, int32_t x, int32_t y, int wall)
+{
+	uint64_t **c;
+	uint64_t   bit;
+
+	if (x < 0 || m->width <= x || y < 0 || m->height <= y)
+		return -1;
+	c = &m->chunks[(size_t)tilemap_chunk(y)*m->xchunks + tilemap_chunk(x)];
+	if (NULL == *c) {
+		if (!wall)
+			return 0;
+		*c = calloc(TILEMAP_CHUNK, sizeof(**c));
+		if (NULL == *c)
+			return -1;
+		m->used++;
+	}
+
+	bit = (uint64_t)1 << (x & TILEMAP_MASK);
+	if (wall)
+		(*c)[y & TILEMAP_MASK] |= bit;
+	else
+		(*c)[y & TILEMAP_MASK] &= ~bit;
+	return 0;
+}
+
+
+/*
+ * Tiles x to x + n - 1 of row y as bits 0 to n - 1, n up to 64. They
+ * span at most two chunks, so this is two words and a shift.
+ */
+uint64_t tilemap_row(tilemap *m, int32_t x, int32_t y, int n)
+{
+	uint64_t *c;
+	uint64_t  bits = 0;
+	int32_t   cx = tilemap_chunk(x);
+	int32_t   cy = tilemap_chunk(y);
+	int       o = x & TILEMAP_MASK;
+
+	if (n < 1)
+		return 0;
+	c = tilemap_find(m, cx, cy);
+	if (NULL != c)
+		bits = c[y & TILEMAP_MASK] >> o;
+	c = tilemap_find(m, cx + 1, cy);
+	if (NULL != c && o)
+		bits |= c[y & TILEMAP_MASK] << (TILEMAP_CHUNK - o);
+	return n < 64 ? bits & (((uint64_t)1 << n) - 1):bits;
+}
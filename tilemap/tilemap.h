@@ -0,0 +1,32 @@
+/*
+ * chunked 1-bit-per-tile map, not thread-safe
+ */
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Tiles are walls (1) or free (0), anything outside the map reads as
+ * free. Storage goes by TILEMAP_CHUNK square chunks, allocated only
+ * once they hold a wall.
+ */
+#define TILEMAP_CHUNK_BITS (6)
+#define TILEMAP_CHUNK      (1 << TILEMAP_CHUNK_BITS)
+
+
+typedef struct tilemap tilemap;
+
+tilemap* tilemap_create(int32_t width, int32_t height);
+int      tilemap_free(  tilemap *m);
+int32_t  tilemap_width( tilemap *m);
+int32_t  tilemap_height(tilemap *m);
+size_t   tilemap_chunks(tilemap *m);
+int      tilemap_get(   tilemap *m, int32_t x, int32_t y);
+int      tilemap_set(   tilemap *m, int32_t x, int32_t y, int wall);
+uint64_t tilemap_row(   tilemap *m, int32_t x, int32_t y, int n);
+
+
+#endif /* !TILEMAP_H */
@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <pthread.h>
+
+#include "tribuf.h"
+
+
+#define WORDS   (256)
+#define ROUNDS  (200000)
+
+
+/* every word of a buffer holds the round it was written in */
+static uint64_t bufs[3][WORDS];
+static tribuf  *t;
+
+
+static void* writer(void *param)
+{
+	uint64_t *b;
+	uint64_t  r;
+	int k;
+
+	(void)param;
+	for (r = 1; r <= ROUNDS; r++) {
+		b = bufs[tribuf_back(t)];
+		for (k = 0; k < WORDS; k++)
+			b[k] = r;
+		tribuf_publish(t);
+	}
+	return NULL;
+}
+
+
+int main()
+{
+	pthread_t thread;
+	uint64_t *b;
+	uint64_t  last = 0;
+	uint64_t  reads = 0;
+	int fails = 0;
+	int k;
+
+
+	t = tribuf_create();
+	if (NULL == t) {
+		perror("tribuf_create");
+		return EXIT_FAILURE;
+	}
+	if (0 != bufs[tribuf_front(t)][0]) {
+		printf("nothing published yet, front should be empty\n");
+		fails++;
+	}
+
+	pthread_create(&thread, NULL, writer, NULL);
+	while (last != ROUNDS && !fails) {
+		b = bufs[tribuf_front(t)];
+		for (k = 1; k < WORDS; k++)
+			if (b[k] != b[0]) {
+				printf("torn buffer: %llu and %llu\n",
+					(unsigned long long)b[0],
+					(unsigned long long)b[k]);
+				fails++;
+				break;
+			}
+		if (b[0] < last) {
+			printf("went back from %llu to %llu\n",
+				(unsigned long long)last,
+				(unsigned long long)b[0]);
+			fails++;
+		}
+		last = b[0];
+		reads++;
+	}
+	pthread_join(thread, NULL);
+	tribuf_free(t);
+
+
+	printf("%llu reads\n", (unsigned long long)reads);
+	printf("%s\n", fails ? "FAIL":"OK");
+	return fails ? EXIT_FAILURE:EXIT_SUCCESS;
+}
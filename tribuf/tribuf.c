@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+
+
+#include "tribuf.h"
+
+
+/*
+ * Each buffer is always exactly one of back (the writer's), front (the
+ * reader's) or middle (the last published, not yet taken). Publishing
+ * swaps back with middle and taking swaps middle with front, both in a
+ * single atomic exchange. The middle word also carries a bit telling
+ * whether it holds something the reader has not seen yet.
+ */
+
+
+#define TRIBUF_FRESH (4u)
+#define TRIBUF_INDEX(v) ((int)((v) & 3u))
+
+
+struct tribuf {
+	atomic_uint middle;
+	int         back;
+	int         front;
+};
+
+
+tribuf* tribuf_create(void)
+{
+	tribuf *t;
+
+	t = calloc(1, sizeof(*t));
+	if (NULL == t)
+		return NULL;
+	t->back  = 0;
+	t->front = 1;
+	atomic_init(&t->middle, 2);
+	return t;
+}
+
+
+int tribuf_free(tribuf *t)
+{
+	if (NULL == t)
+		return -1;
+	free(t);
+	return 0;
+}
+
+
+/* writer side */
+int tribuf_back(tribuf *t)
+{
+	return t->back;
+}
+
+
+/* writer side, the back buffer changes */
+void tribuf_publish(tribuf *t)
+{
+	unsigned v = (unsigned)t->back | TRIBUF_FRESH;
+
+	v = atomic_exchange_explicit(&t->middle, v, memory_order_acq_rel);
+	t->back = TRIBUF_INDEX(v);
+}
+
+
+/* reader side, the newest published buffer or the one it had */
+int tribuf_front(tribuf *t)
+{
+	unsigned v;
+
+	if (!(atomic_load_explicit(&t->middle, memory_order_acquire)
+			& TRIBUF_FRESH))
+		return t->front;
+
+	v = atomic_exchange_explicit(&t->middle, (unsigned)t->front,
+		memory_order_acq_rel);
+	t->front = TRIBUF_INDEX(v);
+	return t->front;
+}
@@ -0,0 +1,22 @@
+/*
+ * lock-free triple buffer between one writer and one reader thread
+ */
+#ifndef TRIBUF_H
+#define TRIBUF_H
+
+
+/*
+ * The caller owns three buffers, this hands out their indices: the
+ * writer fills tribuf_back and publishes it, the reader gets the newest
+ * published one from tribuf_front. Neither ever waits for the other.
+ */
+typedef struct tribuf tribuf;
+
+tribuf* tribuf_create(void);
+int     tribuf_free(   tribuf *t);
+int     tribuf_back(   tribuf *t);
+void    tribuf_publish(tribuf *t);
+int     tribuf_front(  tribuf *t);
+
+
+#endif /* !TRIBUF_H */
@@ -3,19 +3,93 @@
 
 #include "socket.h"
 #include "queue.h"
+#include "record.h"
+#include "wheel.h"
+#include "idmap.h"
+#include "bodies.h"
+#include "tribuf.h"
+#include "tilemap.h"
+#include "spatial.h"
 
 
-#ifndef MAPA_XLEN
-#define MAPA_XLEN (20)
+/* tiles on screen, any bigger map scrolls under them */
+#ifndef VISTA_XLEN
+#define VISTA_XLEN (20)
 #endif
-#ifndef MAPA_YLEN
-#define MAPA_YLEN (20)
+#ifndef VISTA_YLEN
+#define VISTA_YLEN (20)
 #endif
+#define VISTA_FILAS (64)
 
+/* initial capacity of the player and connection tables, both grow */
 #ifndef JUGADORES
 #define JUGADORES (100)
 #endif
 
+#ifndef MAPA_CHUNK
+#define MAPA_CHUNK (256)
+#endif
+#ifndef MAPA_CHUNKS
+#define MAPA_CHUNKS (64)
+#endif
+
+#define FIABLE_VENTANA     (32)
+#define FIABLE_REINTENTOS  (8)
+#define FIABLE_RTO_INICIAL (200)
+#define FIABLE_RTO_MIN     (30)
+#define FIABLE_RTO_MAX     (3000)
+#define FIABLE_INACTIVO_MS (3000)
+#define FIABLE_TICK_MS     (10)
+
+/* default simulation step, --sim-hz sets vj->paso_ms for the session */
+#define PASO_MS (16)
+#define SIM_PASOS_MAX (8)
+#define RENDER_HZ     (60)
+
+#define DR_UMBRAL      (2)
+#define DR_PASOS_MAX   (20)
+
+#define ENVIO_MIN_MS       (PASO_MS)
+#define ENVIO_MAX_MS       (2000)
+#define ENVIO_LATIDO_MS    (250)
+#define ENVIO_REVISION_MS  (1000)
+#define ENVIO_FRENO_MAX    (8)
+#define ENVIO_COLA_MAX     (64)
+
+#define INTERP_LEN      (16)
+#define INTERP_MIN_MS   (2*PASO_MS)
+#define INTERP_MAX_MS   (250)
+
+#define ENTRADA_REDUNDANCIA (8)
+#define ENTRADA_HISTORIAL   (128)
+#define ENTRADA_COLA        (64)
+#define ENTRADA_POR_TICK    (4)
+
+#define ESTADO_JUGADORES (16)
+
+#define RELOJ_INTERVALO_MS (1000)
+#define RELOJ_INICIO_MS    (250)
+#define RELOJ_FILTRO       (8)
+#define RELOJ_DELAY_MAX    (2000)
+
+#define LOCKSTEP_JUGADORES   (16)
+#define LOCKSTEP_RETRASO     (4)
+#define LOCKSTEP_REDUNDANCIA (16)
+#define LOCKSTEP_COLA        (64)
+
+#define MENSAJE_TIPOS (16)
+
+#define MUNDO_BYTES  (384)
+#define MUNDO_PARTES (255)
+
+#define CONEXION_TICK_MS     (10)
+#define CONEXION_ESPERA_MS   (1000)
+#define CONEXION_MAPAS_MS    (5000)
+#define CONEXION_INACTIVO_MS (FIABLE_INACTIVO_MS)
+
+#define JUGADOR_TICK_MS      (100)
+#define JUGADOR_INACTIVO_MS  (3000)
+
 
 enum mensaje_tipo {
 	MENSAJE_PING     = 0,
@@ -24,23 +98,137 @@ enum mensaje_tipo {
 	MENSAJE_READY    = 3,
 	MENSAJE_MAPAS    = 5,
 	MENSAJE_MONEDAS  = 6,
-	MENSAJE_POSICION = 7
+	MENSAJE_POSICION = 7,
+	MENSAJE_ACK      = 9,
+	MENSAJE_ENTRADA  = 10,
+	MENSAJE_ESTADO   = 11,
+	MENSAJE_LOCKSTEP = 12,
+	MENSAJE_MUNDO    = 13
+};
+
+
+/*
+ * Inline handlers run on recv_thread as soon as the message arrives,
+ * deferred ones are queued and applied together by mensajes_aplicar.
+ */
+enum mensaje_manejo {
+	MANEJO_INLINE   = 0,
+	MANEJO_DIFERIDO = 1
+};
+
+
+enum videojuego_modo {
+	MODO_P2P      = 0,
+	MODO_CLIENTE  = 1,
+	MODO_SERVIDOR = 2,
+	MODO_LOCKSTEP = 3
+};
+
+
+enum entrada_tecla {
+	ENTRADA_IZQUIERDA = 0x01,
+	ENTRADA_ARRIBA    = 0x02,
+	ENTRADA_DERECHA   = 0x04,
+	ENTRADA_ABAJO     = 0x08
+};
+
+
+enum fiable_canal {
+	FIABLE_CANAL_NINGUNO = 0,
+	FIABLE_CANAL_CONTROL = 1,
+	FIABLE_CANAL_MAPA    = 2,
+	FIABLE_CANAL_MUNDO   = 3,
+	FIABLE_CANALES       = 4
+};
+
+
+enum mapa_formato {
+	MAPA_FORMATO_BITS = 0,
+	MAPA_FORMATO_RLE  = 1
 };
 
 
 struct mensaje {
-	uint16_t id;
+	uint32_t id;
 	uint8_t  tipo;
 	int32_t  tiempo;
+	uint32_t seq;
+	uint8_t  canal;
+	uint32_t canal_seq;
+	uint32_t canal_base;
 	union {
-		char mapa[MAPA_YLEN][MAPA_XLEN];
 		struct {
-			uint8_t  id;
+			uint32_t destino;
+			uint8_t  canal;
+			uint32_t base;
+			uint32_t mascara;
+		} ack;
+		struct {
+			uint32_t destino;
+			int32_t  t1;
+			int32_t  t2;
+		} pong;
+		struct {
+			uint32_t mapa_hash;
+		} conectar;
+		struct mensaje_mapa {
+			uint32_t hash;
+			uint32_t total;
+			uint16_t xlen;
+			uint16_t ylen;
+			uint16_t chunk;
+			uint16_t chunks;
+			uint16_t len;
+			uint8_t  formato;
+			uint8_t  bytes[MAPA_CHUNK];
+		} mapa;
+		struct {
+			uint32_t id;
 			uint64_t choques;
 			uint64_t puntos;
 			uint16_t x;
 			uint16_t y;
+			int16_t  dx;
+			int16_t  dy;
 		} jugador;
+		struct {
+			uint32_t id;
+			uint32_t seq;
+			uint8_t  n;
+			uint8_t  teclas[ENTRADA_REDUNDANCIA];
+		} entrada;
+		struct {
+			uint32_t tick;
+			uint8_t  n;
+			struct {
+				uint32_t id;
+				int16_t  x;
+				int16_t  y;
+				int16_t  dx;
+				int16_t  dy;
+				uint32_t choques;
+				uint32_t puntos;
+				uint32_t entrada;
+			} jugadores[ESTADO_JUGADORES];
+		} estado;
+		struct {
+			uint32_t id;
+			uint32_t tick;
+			uint8_t  n;
+			uint8_t  teclas[LOCKSTEP_REDUNDANCIA];
+			uint32_t hash_tick;
+			uint32_t hash;
+		} lockstep;
+		struct {
+			uint32_t destino;
+			uint32_t mapa_hash;
+			uint32_t tick;
+			uint16_t jugadores;
+			uint8_t  parte;
+			uint8_t  partes;
+			uint16_t len;
+			uint8_t  bytes[MUNDO_BYTES];
+		} mundo;
 	} datos;
 };
 
@@ -56,13 +244,20 @@ enum conexion_estado {
 	CONEXION_CONECTANDO   = 1,
 	CONEXION_MAPAS        = 2,
 	CONEXION_MONEDAS      = 3,
-	CONEXION_JUGANDO      = 4
+	CONEXION_JUGANDO      = 4,
+	CONEXION_ESTADOS      = 5
 };
 
 
 extern void* recv_thread(void*);
 extern void* send_thread(void*);
 extern void* play_thread(void*);
+extern void* sim_thread(void*);
+
+extern int32_t time_now_ms(void);
+extern void    time_set_ms(int32_t ms);
+
+
 
 
 struct pos {
@@ -79,23 +274,251 @@ struct pelota {
 };
 
 
+/* where a move ran into a wall, t out of IMPACTO_UNO of the way */
+#define IMPACTO_UNO (1 << 16)
+
+struct impacto {
+	int32_t    t;
+	struct pos normal;
+};
+
+
+/*
+ * Received states of a remote player stamped with the sender's clock
+ * (converted to ours), rendered INTERP_MIN_MS plus three times the
+ * arrival jitter behind now.
+ */
+struct interpolacion {
+	struct {
+		int32_t       tiempo;
+		uint64_t      choques;
+		struct pelota pelota;
+	}       buf[INTERP_LEN];
+	size_t  len;
+	size_t  cabeza;
+	int32_t jitter;
+	int32_t llegada;
+	int32_t envio;
+};
+
+
+/*
+ * Send scheduler of a locally simulated player: prediccion is what
+ * remote peers are extrapolating since the last send.
+ */
+struct envio {
+	struct pelota prediccion;
+	uint64_t      choques;
+	int           sucio;
+	int32_t       enviado;
+	int32_t       latido;
+	int32_t       min_ms;
+	int32_t       max_ms;
+};
+
+
 struct jugador {
-	uint8_t            id;
+	uint32_t             id;
+	struct socket_addr   addr;
+	int                  ultimo_ping;
+	struct jugador_temporizador *temporizador;
+	int                  ultimo_movimiento;
+	uint64_t             choques;
+	uint64_t             puntos;
+	struct interpolacion interp;
+	struct envio         envio;
+
+	/* inputs of a server-simulated player */
+	uint32_t             entrada_recibida;
+	uint32_t             entrada_aplicada;
+	uint8_t              entradas[ENTRADA_COLA];
+};
+
+
+/*
+ * Keys pressed since the last MENSAJE_ENTRADA and the ones sent, which
+ * are resent for redundancy and replayed on top of each snapshot until
+ * the server reports them applied (confirmada).
+ */
+struct entrada_local {
+	uint32_t seq;
+	uint32_t confirmada;
+	uint8_t  teclas;
+	uint8_t  historial[ENTRADA_HISTORIAL];
+};
+
+
+/*
+ * A player of a lockstep match: its input for tick t lives in
+ * teclas[t%LOCKSTEP_COLA] and every tick before hasta is known.
+ */
+struct lockstep_jugador {
+	uint32_t id;
+	uint32_t hasta;
+	uint8_t  teclas[LOCKSTEP_COLA];
+	uint32_t hash_tick;
+	uint32_t hash;
+	int      hash_nuevo;
+};
+
+
+struct lockstep {
+	int      jugadores;
+	int      iniciado;
+	uint32_t tick;
+	uint32_t hashes[LOCKSTEP_COLA];
+	uint64_t desincronizado;
+	uint64_t esperas;
+	struct lockstep_jugador j[LOCKSTEP_JUGADORES];
+	size_t                  len;
+};
+
+
+enum secuencia_resultado {
+	SECUENCIA_DUPLICADO = -1,
+	SECUENCIA_NUEVO     =  0,
+	SECUENCIA_ATRASADO  =  1
+};
+
+
+/*
+ * Sliding window over the last 64 sequence numbers seen from a sender,
+ * bit i of ventana is set when ultimo - i has been received.
+ */
+struct secuencia {
+	uint32_t ultimo;
+	uint64_t ventana;
+	int      iniciada;
+	uint64_t recibidos;
+	uint64_t perdidos;
+	uint64_t duplicados;
+	uint64_t desordenados;
+};
+
+
+/* RFC 6298 style estimator, all values in ms */
+struct rtt {
+	int32_t srtt;
+	int32_t rttvar;
+	int32_t rto;
+	int     muestras;
+};
+
+
+/*
+ * NTP-style offset of the peer's clock (remote - local), keeping the
+ * lowest-delay sample out of the last RELOJ_FILTRO as the least noisy.
+ */
+struct reloj {
+	int32_t offset;
+	int32_t jitter;
+	int     muestras;
+	struct {
+		int32_t offset;
+		int32_t delay;
+	}       filtro[RELOJ_FILTRO];
+};
+
+
+struct conexion {
+	uint32_t           id;
 	struct socket_addr addr;
-	int                ultimo_ping;
-	int                ultimo_movimiento;
-	uint64_t           choques;
-	uint64_t           puntos;
-	uint8_t            estado;
-	struct pelota      pelota;
+	int32_t            ultimo_paquete;
+	int                estado;
+	struct wheel_node  temporizador;
+	struct secuencia   secuencia;
+	struct rtt         rtt;
+	struct reloj       reloj;
+
+	/* what the peer has acked of our reliable channels */
+	struct conexion_ack {
+		int      iniciado;
+		uint32_t base;
+		uint32_t mascara;
+	} ack[FIABLE_CANALES];
+
+	/* what we have received on the peer's reliable channels */
+	struct conexion_rx {
+		int      iniciado;
+		uint32_t esperado;
+		uint32_t presentes;
+		struct queue_message *pendientes;
+	} rx[FIABLE_CANALES];
+};
+
+
+struct fiable_entrada {
+	struct queue_message qm;
+	int                  usado;
+	int                  intentos;
+	int32_t              enviado;
+	int32_t              reenviado;
+};
+
+
+struct fiable_canal_envio {
+	uint32_t              siguiente;
+	uint32_t              base;
+	struct fiable_entrada ventana[FIABLE_VENTANA];
+	queue                *pendientes;
+};
+
+
+/*
+ * What a frame draws, published whole by the simulating thread so the
+ * render loop never takes vj->lock. Our player goes first, previa is
+ * where its ball was one step earlier.
+ */
+struct vista_jugador {
+	uint32_t id;
+	struct pos pos;
+	int      r;
+	uint64_t puntos;
+	uint64_t choques;
+};
+
+/* the wall rows under the tiles x0, y0 to x0 + xlen, y0 + ylen */
+struct vista {
+	struct vista_jugador *jugadores;
+	size_t                len;
+	size_t                cap;
+	struct pos            previa;
+	int32_t               tiempo;      /* when it was published */
+	int32_t               mapa_xlen;
+	int32_t               mapa_ylen;
+	int32_t               x0;
+	int32_t               y0;
+	int                   xlen;
+	int                   ylen;
+	uint64_t              paredes[VISTA_FILAS];
+};
+
+
+struct videojuego;
+
+typedef void (*mensaje_manejador)(struct videojuego*, struct queue_message*);
+
+struct mensaje_manejador_registro {
+	mensaje_manejador fn;
+	int               manejo;
 };
 
 
 struct videojuego {
-	uint8_t      id;
+	uint32_t     id;        /* renewed on recv_thread after a clash */
 	const char  *host;
 	const char  *group;
 	int          port;
+	int          modo;
+
+	/* steps and frames per second, every peer must share the step */
+	int          sim_hz;
+	int          render_hz;
+	int32_t      paso_ms;
+
+	/* every datagram sent and received, when --record is given */
+	const char  *grabacion_ruta;
+	record      *grabacion;
 
 	socket_fd          sock;
 	struct socket_addr self_addr;
@@ -103,20 +526,209 @@ struct videojuego {
 	struct socket_addr group_addr;
 
 	queue *queue_send;
+	uint32_t seq;
+
+	/* handlers by mensaje_tipo and the deferred messages not yet applied */
+	struct mensaje_manejador_registro manejadores[MENSAJE_TIPOS];
+	queue                            *queue_diferidos;
+
+	/* allocated one by one, the timer wheel points into them */
+	struct conexion **conexiones;
+	size_t            conexiones_len;
+	size_t            conexiones_cap;
+	idmap            *conexiones_indice;  /* id -> slot in conexiones */
+
+	/* timeouts of every handshake state, local and per peer */
+	wheel            *temporizadores;
+	int               union_estado;
+	struct wheel_node union_temporizador;
+	size_t            conexion_estados[CONEXION_ESTADOS];
+	uint64_t          conexion_transiciones[CONEXION_ESTADOS][CONEXION_ESTADOS];
+	uint64_t          conexiones_perdidos;   /* of the peers forgotten */
+	uint64_t          conexiones_recibidos;
+
+	/* parts of the world snapshot received while joining */
+	uint8_t           mundo_partes;
+	uint8_t           mundo_faltan;
+	uint64_t          mundo_recibidas[(MUNDO_PARTES + 63)/64];
+
+	pthread_mutex_t           fiable_lock;
+	struct fiable_canal_envio fiable[FIABLE_CANALES];
+	uint64_t                  fiable_enviados;
+	uint64_t                  fiable_reenviados;
+	int32_t                   fiable_revisado;
+
+	int32_t reloj_ping;
+
+	struct socket_addr servidor_addr;
+	int                servidor_conocido;
+	uint32_t           servidor_tick;
+	spatial           *servidor_cercanos;  /* balls, for each client's snapshot */
+
+	/* inputs of the local player in MODO_CLIENTE */
+	struct entrada_local entrada;
+
+	/* congestion multiplier on every player's minimum send interval */
+	int      envio_freno;
+	int32_t  envio_revisado;
+	uint64_t envio_perdidos;
+	uint64_t envio_recibidos;
+	uint64_t envio_fiables;
+	uint64_t envio_reenviados;
+
+	/* MODO_LOCKSTEP, players sorted by id */
+	struct lockstep lockstep;
 
 
 	int width;
 	int height;
 	int tile_length;
 
-	char mapa[MAPA_YLEN][MAPA_XLEN + 1];
+	tilemap    *mapa;
+	const char *mapa_ruta;
+	uint32_t mapa_hash;
+	struct {
+		uint8_t  bytes[MAPA_CHUNK*MAPA_CHUNKS];
+		uint32_t len;
+		uint16_t chunks;
+		uint8_t  formato;
+	} mapa_tx;
+	struct {
+		uint8_t  bytes[MAPA_CHUNK*MAPA_CHUNKS];
+		uint32_t hash;
+		uint32_t total;
+		uint16_t chunks;
+		uint16_t xlen;
+		uint16_t ylen;
+		uint64_t recibidos;
+		uint8_t  formato;
+	} mapa_rx;
 	struct {
 		int hue;
 		int sat;
 		int light;
 	} bg_color;
 
+	/*
+	 * Grows when a player is added, so pointers into it are only good
+	 * while vj->lock is held or on the thread applying deferred messages.
+	 */
 	pthread_mutex_t lock;
-	struct jugador  jugadores[JUGADORES];
+	struct jugador *jugadores;
 	size_t          jugadores_len;
+	size_t          jugadores_cap;
+	idmap          *jugadores_indice;  /* id -> slot in jugadores */
+	bodies         *pelotas;           /* ball of jugadores[i] at i */
+	wheel          *jugadores_temporizadores;
+
+	struct vista vistas[3];
+	tribuf      *vistas_tb;
 };
+
+
+extern void mensaje_recibir(struct videojuego *vj, struct queue_message *qm);
+extern void mensaje_registrar(struct videojuego *vj, int tipo,
+		mensaje_manejador fn, int manejo);
+extern void mensajes_iniciar(struct videojuego *vj);
+extern void mensajes_aplicar(struct videojuego *vj);
+
+extern struct conexion* conexion_buscar(struct videojuego *vj, uint32_t id);
+extern struct conexion* conexion_obtener(struct videojuego *vj,
+		uint32_t id, const struct socket_addr *addr);
+extern int secuencia_registrar(struct secuencia *sq, uint32_t seq);
+extern int  conexion_iniciar(struct videojuego *vj);
+extern void conexion_unirse(struct videojuego *vj);
+extern void conexion_mapa(struct videojuego *vj, int completo);
+extern int  conexion_responde(struct videojuego *vj, uint32_t joiner);
+extern void conexion_evento(struct videojuego *vj, struct queue_message *qm);
+extern void conexion_revisar(struct videojuego *vj);
+
+extern void rtt_muestra(struct rtt *r, int32_t ms);
+extern int  fiable_iniciar(struct videojuego *vj);
+extern int  fiable_enviar(struct videojuego *vj, int canal,
+		struct queue_message *qm);
+extern void fiable_recibir(struct videojuego *vj, struct conexion *c,
+		struct queue_message *qm,
+		void (*entregar)(struct videojuego*, struct queue_message*));
+extern void fiable_ack(struct videojuego *vj, struct conexion *c,
+		struct queue_message *qm);
+extern void fiable_revisar(struct videojuego *vj);
+
+extern void reloj_ping(struct videojuego *vj, struct queue_message *qm);
+extern void reloj_pong(struct videojuego *vj, struct queue_message *qm);
+extern void reloj_revisar(struct videojuego *vj);
+extern int  reloj_offset(struct videojuego *vj, uint32_t id, int32_t *offset);
+extern int  reloj_rtt(struct videojuego *vj, uint32_t id, int32_t *rtt);
+
+extern struct videojuego* videojuego_crear(int argc, char **argv, int modo);
+extern uint32_t id_aleatorio(void);
+extern uint32_t id_renovar(uint32_t id, const struct socket_addr *addr);
+
+extern void pelota_paso(struct pelota *p);
+extern void pelota_extrapolar(struct pelota *p, int pasos);
+extern void pelota_entrada(struct pelota *p, int teclas);
+extern void pelota_reiniciar(struct videojuego *vj, struct pelota *p);
+extern int  pelota_barrer(struct videojuego *vj, const struct pos *desde,
+		const struct pelota *p, struct impacto *im);
+extern int  pelota_simular(struct videojuego *vj, struct pelota *p, int teclas);
+extern int  jugador_paso(struct videojuego *vj, struct jugador *j, int teclas,
+		int32_t ahora);
+extern void update_jugadores(struct videojuego *vj);
+extern struct jugador* jugador_buscar(struct videojuego *vj, uint32_t id);
+extern struct jugador* jugador_nuevo(struct videojuego *vj, uint32_t id);
+extern void jugador_quitar(struct videojuego *vj, size_t i);
+extern void jugador_renovar(struct videojuego *vj, struct jugador *j,
+		const struct socket_addr *addr);
+extern void jugadores_revisar(struct videojuego *vj);
+extern struct pelota jugador_pelota(struct videojuego *vj,
+		const struct jugador *j);
+extern void jugador_pelota_poner(struct videojuego *vj,
+		const struct jugador *j, const struct pelota *p);
+extern void jugador_reiniciar(struct videojuego *vj, struct jugador *j);
+extern int  jugador_simular(struct videojuego *vj, struct jugador *j,
+		const struct pos *desde, struct pelota *p, int32_t ahora);
+extern void jugador_entrada_recibir(struct jugador *j, uint32_t seq,
+		const uint8_t *teclas, int n);
+extern int  jugador_entrada_aplicar(struct videojuego *vj, struct jugador *j,
+		int32_t ahora);
+extern void jugador_actualizar(struct videojuego *vj, uint32_t id,
+		const struct pelota *p, int32_t envio,
+		uint64_t puntos, uint64_t choques);
+extern void jugador_agregar(struct videojuego *vj, struct queue_message *qm);
+
+extern void entrada_enviar(struct videojuego *vj, uint32_t id,
+		struct entrada_local *e);
+extern void entrada_predecir(struct videojuego *vj);
+extern void entrada_recibir(struct videojuego *vj, struct queue_message *qm);
+extern void estado_enviar(struct videojuego *vj);
+extern void estado_recibir(struct videojuego *vj, struct queue_message *qm);
+
+extern void envio_iniciar(struct envio *e, int32_t min_ms, int32_t max_ms);
+extern int  envio_debe_enviar(struct videojuego *vj, struct jugador *j,
+		const struct pelota *p, int32_t ahora);
+extern void envio_enviado(struct jugador *j, const struct pelota *p,
+		int32_t ahora);
+extern void envio_revisar(struct videojuego *vj);
+
+extern void mundo_enviar(struct videojuego *vj, struct queue_message *qm);
+extern void mundo_recibir(struct videojuego *vj, struct queue_message *qm);
+
+extern void* lockstep_thread(void *param);
+extern void  lockstep_recibir(struct videojuego *vj, struct queue_message *qm);
+
+extern void interp_agregar(struct interpolacion *in, int32_t envio,
+		int32_t llegada, uint64_t choques, const struct pelota *p);
+extern int  interp_retraso(const struct interpolacion *in);
+extern int  interp_posicion(const struct interpolacion *in, int32_t ahora,
+		int32_t paso_ms, struct pos *pos);
+
+extern void vista_publicar(struct videojuego *vj, const struct pos *previa,
+		int32_t ahora);
+extern void vista_camara(struct videojuego *vj, const struct vista *v,
+		const struct pos *centro, struct pos *camara);
+
+extern int  mapa_cargar(struct videojuego *vj, const char *ruta);
+extern int  mapa_preparar(struct videojuego *vj);
+extern void mapa_conectar(struct videojuego *vj);
+extern void mapa_enviar(struct videojuego *vj, uint64_t chunks);
+extern void mapa_recibir(struct videojuego *vj, struct queue_message *qm);
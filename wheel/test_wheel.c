@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "wheel.h"
+
+
+#define TIMERS  (100000)
+#define TICK_MS (10)
+#define SPAN_MS (600000)
+#define STEP_MS (3)
+
+
+struct timer {
+	struct wheel_node node;
+	uint32_t          expires;
+	uint32_t          added;
+	int               fired;
+	int               rearm;
+};
+
+
+static uint32_t now;
+static int      fails;
+
+
+static void expire(struct wheel_node *n, void *arg)
+{
+	struct timer *t = n->data;
+	wheel   *w = arg;
+	uint32_t due = t->expires;
+
+	/* past due when added, it is for the next tick */
+	if ((int32_t)(t->added - due) > 0)
+		due = t->added;
+	/* and the clock moves in steps of up to STEP_MS */
+	if ((int32_t)(now - t->expires) < 0
+	||  TICK_MS + STEP_MS <= (int32_t)(now - due)) {
+		if (fails++ < 10)
+			printf("timer due at %u fired at %u\n", t->expires, now);
+	}
+	t->fired++;
+
+	/* half of them come back once, from inside the callback */
+	if (t->rearm) {
+		t->rearm = 0;
+		t->expires = now + rand()%(2*TICK_MS);
+		t->added = now;
+		wheel_add(w, &t->node, t->expires);
+	}
+}
+
+
+int main()
+{
+	static struct timer timers[TIMERS];
+	uint32_t start = 0xffffffff - SPAN_MS/2;
+	size_t   expected = 0;
+	size_t   fired = 0;
+	clock_t  c;
+	wheel   *w;
+	int i;
+
+
+	srand(1);
+	now = start;
+	w = wheel_create(TICK_MS, now);
+	if (NULL == w) {
+		perror("wheel_create");
+		return EXIT_FAILURE;
+	}
+
+	c = clock();
+	for (i = 0; i < TIMERS; i++) {
+		timers[i].node.data = &timers[i];
+		timers[i].expires = now + rand()%SPAN_MS;
+		timers[i].added = now;
+		timers[i].rearm = i%2;
+		wheel_add(w, &timers[i].node, timers[i].expires);
+	}
+	/* a tenth are moved and a tenth cancelled before they fire */
+	for (i = 0; i < TIMERS; i += 10) {
+		timers[i].expires = now + rand()%SPAN_MS;
+		wheel_add(w, &timers[i].node, timers[i].expires);
+		if (-1 == wheel_remove(w, &timers[i + 5].node)) {
+			printf("timer %d was not pending\n", i + 5);
+			fails++;
+		}
+	}
+	for (i = 0; i < TIMERS; i++)
+		expected += 0 == i%10 - 5 ? 0:1 + timers[i].rearm;
+	if (TIMERS - TIMERS/10 != wheel_size(w)) {
+		printf("%zu pending, expected %d\n", wheel_size(w),
+			TIMERS - TIMERS/10);
+		fails++;
+	}
+
+	while ((int32_t)(now - start) < SPAN_MS + 4*TICK_MS) {
+		now += 1 + rand()%STEP_MS;
+		fired += wheel_advance(w, now, expire, w);
+	}
+	c = clock() - c;
+
+	if (expected != fired || 0 != wheel_size(w)) {
+		printf("%zu fired, expected %zu (%zu pending)\n",
+			fired, expected, wheel_size(w));
+		fails++;
+	}
+	for (i = 0; i < TIMERS; i++)
+		if (wheel_pending(&timers[i].node)) {
+			printf("timer %d still pending\n", i);
+			fails++;
+			break;
+		}
+	printf("%zu timers over %d ms in %.1f ms\n", fired, SPAN_MS,
+		1000.0*c/CLOCKS_PER_SEC);
+	wheel_free(w);
+
+
+	printf("%s\n", fails ? "FAIL":"OK");
+	return fails ? EXIT_FAILURE:EXIT_SUCCESS;
+}
@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "wheel.h"
+
+
+/*
+ * WHEEL_LEVELS rings of WHEEL_SLOTS lists, level l holding the timers
+ * due within WHEEL_SLOTS^(l + 1) ticks. Every WHEEL_SLOTS ticks the next
+ * slot of the level above is spread over the one below (cascading), so
+ * adding and removing are O(1) and advancing costs one slot per tick
+ * plus the timers that actually expire.
+ *
+ * Ticks count from wheel_create, so a wheel lasts about 24 days of
+ * milliseconds. Timers never fire early, and at most a tick after they
+ * were due or added, whichever is later.
+ */
+
+
+#define WHEEL_MASK  (WHEEL_SLOTS - 1)
+#define WHEEL_RANGE ((uint32_t)1 << WHEEL_BITS*WHEEL_LEVELS)
+
+
+struct wheel {
+	uint32_t tick_ms;
+	uint32_t base_ms;
+	uint32_t next;
+	size_t   len;
+	struct wheel_node slots[WHEEL_LEVELS][WHEEL_SLOTS];
+};
+
+
+/* expiry times round up and the current time down, so nothing fires early */
+static uint32_t wheel_tick(wheel *w, uint32_t ms, uint32_t round)
+{
+	int32_t d = ms - w->base_ms;
+
+	if (d <= 0)
+		return 0;
+	return ((uint32_t)d + round)/w->tick_ms;
+}
+
+
+static void list_push(struct wheel_node *head, struct wheel_node *n)
+{
+	n->prev = head->prev;
+	n->next = head;
+	head->prev->next = n;
+	head->prev = n;
+}
+
+
+static void list_unlink(struct wheel_node *n)
+{
+	n->prev->next = n->next;
+	n->next->prev = n->prev;
+	n->next = NULL;
+	n->prev = NULL;
+}
+
+
+/* moves every node of slot to the detached list head */
+static void list_take(struct wheel_node *slot, struct wheel_node *head)
+{
+	head->next = head;
+	head->prev = head;
+	if (slot->next == slot)
+		return;
+	head->next = slot->next;
+	head->prev = slot->prev;
+	head->next->prev = head;
+	head->prev->next = head;
+	slot->next = slot;
+	slot->prev = slot;
+}
+
+
+static void wheel_put(wheel *w, struct wheel_node *n)
+{
+	uint32_t d = n->expires - w->next;
+	uint32_t e = n->expires;
+	int l;
+
+	if ((int32_t)d < 0) {
+		list_push(&w->slots[0][w->next & WHEEL_MASK], n);
+		return;
+	}
+	if (WHEEL_RANGE <= d)
+		e = w->next + WHEEL_RANGE - 1;
+	d = e - w->next;
+
+	for (l = 0; l < WHEEL_LEVELS - 1; l++)
+		if (d < (uint32_t)1 << WHEEL_BITS*(l + 1))
+			break;
+	list_push(&w->slots[l][(e >> WHEEL_BITS*l) & WHEEL_MASK], n);
+}
+
+
+/* re-adds the timers of a higher level slot, returns the slot index */
+static int wheel_cascade(wheel *w, int l)
+{
+	struct wheel_node  head;
+	struct wheel_node *n;
+	int i = (w->next >> WHEEL_BITS*l) & WHEEL_MASK;
+
+	list_take(&w->slots[l][i], &head);
+	while (head.next != &head) {
+		n = head.next;
+		list_unlink(n);
+		wheel_put(w, n);
+	}
+	return i;
+}
+
+
+wheel* wheel_create(uint32_t tick_ms, uint32_t now_ms)
+{
+	wheel *w;
+	int l;
+	int i;
+
+	if (0 == tick_ms)
+		return NULL;
+	w = calloc(1, sizeof(*w));
+	if (NULL == w)
+		return NULL;
+
+	w->tick_ms = tick_ms;
+	w->base_ms = now_ms;
+	for (l = 0; l < WHEEL_LEVELS; l++)
+	for (i = 0; i < WHEEL_SLOTS; i++) {
+		w->slots[l][i].next = &w->slots[l][i];
+		w->slots[l][i].prev = &w->slots[l][i];
+	}
+	return w;
+}
+
+
+int wheel_free(wheel *w)
+{
+	struct wheel_node *n;
+	int l;
+	int i;
+
+	if (NULL == w)
+		return -1;
+	for (l = 0; l < WHEEL_LEVELS; l++)
+	for (i = 0; i < WHEEL_SLOTS; i++)
+		while (w->slots[l][i].next != &w->slots[l][i]) {
+			n = w->slots[l][i].next;
+			list_unlink(n);
+		}
+	free(w);
+	return 0;
+}
+
+
+size_t wheel_size(wheel *w)
+{
+	return w->len;
+}
+
+
+int wheel_pending(const struct wheel_node *n)
+{
+	return NULL != n->next;
+}
+
+
+/* an already pending node is moved to its new time */
+void wheel_add(wheel *w, struct wheel_node *n, uint32_t expires_ms)
+{
+	if (NULL != n->next)
+		list_unlink(n);
+	else
+		w->len++;
+	n->expires = wheel_tick(w, expires_ms, w->tick_ms - 1);
+	wheel_put(w, n);
+}
+
+
+int wheel_remove(wheel *w, struct wheel_node *n)
+{
+	if (NULL == n->next)
+		return -1;
+	list_unlink(n);
+	w->len--;
+	return 0;
+}
+
+
+/*
+ * Calls fn on every timer due by now_ms, already removed so fn may add
+ * it again. Returns how many expired.
+ */
+size_t wheel_advance(wheel *w, uint32_t now_ms, wheel_expire fn, void *arg)
+{
+	struct wheel_node  head;
+	struct wheel_node *n;
+	uint32_t now = wheel_tick(w, now_ms, 0);
+	size_t   expired = 0;
+	int      i;
+	int      l;
+
+	while ((int32_t)(now - w->next) >= 0) {
+		if (0 == w->len) {
+			w->next = now + 1;
+			break;
+		}
+
+		i = w->next & WHEEL_MASK;
+		for (l = 1; 0 == i && l < WHEEL_LEVELS; l++)
+			i = wheel_cascade(w, l);
+
+		list_take(&w->slots[0][w->next & WHEEL_MASK], &head);
+		w->next++;
+		while (head.next != &head) {
+			n = head.next;
+			list_unlink(n);
+			w->len--;
+			expired++;
+			fn(n, arg);
+		}
+	}
+	return expired;
+}
@@ -0,0 +1,41 @@
+/*
+ * hierarchical timing wheel, not thread-safe
+ */
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define WHEEL_BITS   (6)
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_LEVELS (4)
+
+
+/*
+ * Embedded in whatever the timer belongs to, zeroed before first use.
+ * Times are milliseconds on a wrapping 32-bit clock.
+ */
+struct wheel_node {
+	struct wheel_node *next;
+	struct wheel_node *prev;
+	uint32_t           expires;
+	void              *data;
+};
+
+
+typedef struct wheel wheel;
+
+typedef void (*wheel_expire)(struct wheel_node *n, void *arg);
+
+wheel* wheel_create( uint32_t tick_ms, uint32_t now_ms);
+int    wheel_free(   wheel *w);
+size_t wheel_size(   wheel *w);
+int    wheel_pending(const struct wheel_node *n);
+void   wheel_add(    wheel *w, struct wheel_node *n, uint32_t expires_ms);
+int    wheel_remove( wheel *w, struct wheel_node *n);
+size_t wheel_advance(wheel *w, uint32_t now_ms, wheel_expire fn, void *arg);
+
+
+#endif /* !WHEEL_H */